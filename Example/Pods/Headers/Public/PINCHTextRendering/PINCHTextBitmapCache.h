@@ -0,0 +1 @@
+../../../../../PINCHTextRendering/PINCHTextBitmapCache.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../PINCHTextRendering/PINCHTextDataDetector.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../PINCHTextRendering/PINCHTextHyphenator.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../PINCHTextRendering/PINCHTextLayoutResult.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../PINCHTextRendering/PINCHTextLinkIndex.h
\ No newline at end of file
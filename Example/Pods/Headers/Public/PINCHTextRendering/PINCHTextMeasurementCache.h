@@ -0,0 +1 @@
+../../../../../PINCHTextRendering/PINCHTextMeasurementCache.h
\ No newline at end of file
@@ -0,0 +1 @@
+../../../../../PINCHTextRendering/PINCHTextPrefetcher.h
\ No newline at end of file
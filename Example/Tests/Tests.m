@@ -6,9 +6,126 @@
 //  Copyright (c) 2014 PINCH B.V. All rights reserved.
 //
 #import <PINCHTextRendering/PINCHTextRendering.h>
+#import <PINCHTextRendering/PINCHTextLink.h>
 #import <UIKit/UIKit.h>
 #include <Expecta+Snapshots/EXPMatchers+FBSnapshotTest.h>
 
+/// Renderer delegate that keeps the links it's been given
+@interface PINCHTestLinkDelegate : NSObject <PINCHTextRendererDelegate>
+
+@property (nonatomic, assign) NSUInteger numberOfDeliveries;
+@property (nonatomic, copy) NSArray *links;
+
+/// URLs and textCheckingResults given one at a time, when textLayouts are drawn outside of the renderer
+@property (nonatomic, strong) NSMutableArray *encounteredValues;
+
+@end
+
+@implementation PINCHTestLinkDelegate
+
+- (void)textRenderer:(PINCHTextRenderer *)textRenderer didEncounterLinks:(NSArray *)links
+{
+	self.numberOfDeliveries++;
+	self.links = links;
+}
+
+- (void)textRenderer:(PINCHTextRenderer *)textRenderer didEncounterURL:(NSURL *)URL inRange:(NSRange)range withRect:(CGRect)rect
+{
+	self.encounteredValues = self.encounteredValues ?: [NSMutableArray array];
+	[self.encounteredValues addObject:URL];
+}
+
+- (void)textRenderer:(PINCHTextRenderer *)textRenderer didEncounterTextCheckingResult:(NSTextCheckingResult *)result inRange:(NSRange)range withRect:(CGRect)rect
+{
+	self.encounteredValues = self.encounteredValues ?: [NSMutableArray array];
+	[self.encounteredValues addObject:result];
+}
+
+@end
+
+/// Layout that keeps every framesetter and hyphenated line it typesets with, so specs can check which ones are reused
+@interface PINCHTestTypesettingLayout : PINCHTextLayout
+
+@property (nonatomic, strong, readonly) NSMutableArray *framesetters;
+@property (nonatomic, strong, readonly) NSMutableArray *hyphenatedLines;
+
+@end
+
+@interface PINCHTextLayout ()
+
+- (CTFramesetterRef)framesetterWithScaleFactor:(CGFloat)scaleFactor;
+- (CTLineRef)newHyphenatedLineAtIndex:(NSUInteger)lineIndex withRange:(NSRange)lineRange widthAvailable:(CGFloat)widthAvailable fontSize:(CGFloat)fontSize justified:(BOOL)justified attributedString:(NSAttributedString *)attributedString;
+
+@end
+
+@implementation PINCHTestTypesettingLayout
+
+- (instancetype)initWithString:(NSString *)string attributes:(NSDictionary *)attributes name:(NSString *)name
+{
+	self = [super initWithString:string attributes:attributes name:name];
+	if (self)
+	{
+		_framesetters = [NSMutableArray array];
+		_hyphenatedLines = [NSMutableArray array];
+	}
+	return self;
+}
+
+- (CTFramesetterRef)framesetterWithScaleFactor:(CGFloat)scaleFactor
+{
+	CTFramesetterRef framesetter = [super framesetterWithScaleFactor:scaleFactor];
+	@synchronized(_framesetters)
+	{
+		if ([_framesetters indexOfObjectIdenticalTo:(__bridge id)framesetter] == NSNotFound)
+		{
+			[_framesetters addObject:(__bridge id)framesetter];
+		}
+	}
+	return framesetter;
+}
+
+- (CTLineRef)newHyphenatedLineAtIndex:(NSUInteger)lineIndex withRange:(NSRange)lineRange widthAvailable:(CGFloat)widthAvailable fontSize:(CGFloat)fontSize justified:(BOOL)justified attributedString:(NSAttributedString *)attributedString
+{
+	CTLineRef line = [super newHyphenatedLineAtIndex:lineIndex withRange:lineRange widthAvailable:widthAvailable fontSize:fontSize justified:justified attributedString:attributedString];
+	@synchronized(_hyphenatedLines)
+	{
+		[_hyphenatedLines addObject:(__bridge id)line];
+	}
+	return line;
+}
+
+@end
+
+/// Layout that underlines its lines one at a time, the result underlining all lines at once has to match
+@interface PINCHTestLineByLineUnderlineLayout : PINCHTextLayout
+
+@end
+
+@interface PINCHTextLayout ()
+
+- (void)drawUnderlinesOfLines:(NSArray *)lines frames:(const CGRect *)frames inContext:(CGContextRef)context font:(UIFont *)font textColor:(UIColor *)textColor fixUnderlinePosition:(BOOL)fixUnderlinePosition;
+
+@end
+
+@implementation PINCHTestLineByLineUnderlineLayout
+
+- (void)drawUnderlinesOfLines:(NSArray *)lines frames:(const CGRect *)frames inContext:(CGContextRef)context font:(UIFont *)font textColor:(UIColor *)textColor fixUnderlinePosition:(BOOL)fixUnderlinePosition
+{
+	for (NSUInteger index = 0; index < [lines count]; index++)
+	{
+		[super drawUnderlinesOfLines:@[lines[index]] frames:&frames[index] inContext:context font:font textColor:textColor fixUnderlinePosition:fixUnderlinePosition];
+	}
+}
+
+@end
+
+/// Private rendering the specs check asynchronous display with
+@interface PINCHTextRenderer ()
+
+- (UIImage *)imageOfTextLayouts:(NSArray *)textLayouts withSize:(CGSize)size scale:(CGFloat)scale cancelToken:(PINCHTextPrefetchToken *)cancelToken delegateCalls:(NSArray **)delegateCalls;
+
+@end
+
 SpecBegin(InitialSpecs)
 
 describe(@"Creating layout objects", ^{
@@ -45,6 +162,120 @@ describe(@"Height calculation", ^{
 		expect(@(CGRectGetHeight(boundingRect))).to.beGreaterThan(@(0));
 	});
 	
+	it(@"scales down to fit", ^{
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"A headline that should be scaled down" attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:30], PINCHTextLayoutMaximumNumberOfLinesAttribute : @1, PINCHTextLayoutMinimumScaleFactorAttribute : @0.3} name:nil];
+		CGRect clippingRect = CGRectZero;
+		CGRect narrowBounds = CGRectMake(0, 0, 300, 640);
+		[layout boundingRectForProposedRect:narrowBounds withClippingRect:&clippingRect containerRect:narrowBounds];
+		CGFloat narrowScaleFactor = layout.actualScaleFactor;
+		expect(@(layout.stringFitsProposedRect)).to.beTruthy;
+		expect(@(narrowScaleFactor)).to.beLessThan(@1);
+		expect(@(narrowScaleFactor)).to.beGreaterThanOrEqualTo(@0.3);
+		
+		// Fitting a wider rect first shouldn't change the scale factor found for the narrow rect
+		CGRect wideBounds = CGRectMake(0, 0, 400, 640);
+		[layout boundingRectForProposedRect:wideBounds withClippingRect:&clippingRect containerRect:wideBounds];
+		expect(@(layout.actualScaleFactor)).to.beGreaterThan(@(narrowScaleFactor));
+		[layout boundingRectForProposedRect:narrowBounds withClippingRect:&clippingRect containerRect:narrowBounds];
+		expect(@(layout.actualScaleFactor)).to.equal(@(narrowScaleFactor));
+	});
+	
+	it(@"returns cached results for alternating rects", ^{
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"Test string that will wrap over multiple lines when the width is small enough" attributes:nil name:nil];
+		CGRect clippingRect = CGRectZero;
+		CGRect probeBounds = CGRectMake(0, 0, CGFLOAT_MAX, CGFLOAT_MAX);
+		CGRect bounds = CGRectMake(0, 0, 100, 640);
+		CGRect probeRect = [layout boundingRectForProposedRect:probeBounds withClippingRect:&clippingRect containerRect:bounds];
+		CGRect boundingRect = [layout boundingRectForProposedRect:bounds withClippingRect:&clippingRect containerRect:bounds];
+		NSUInteger numberOfLines = layout.actualNumberOfLines;
+		
+		expect(@(CGRectEqualToRect([layout boundingRectForProposedRect:probeBounds withClippingRect:&clippingRect containerRect:bounds], probeRect))).to.beTruthy;
+		expect(@(layout.actualNumberOfLines)).to.equal(@1);
+		expect(@(CGRectEqualToRect([layout boundingRectForProposedRect:bounds withClippingRect:&clippingRect containerRect:bounds], boundingRect))).to.beTruthy;
+		expect(@(layout.actualNumberOfLines)).to.equal(@(numberOfLines));
+		expect(@([layout.lineRects count])).to.equal(@(numberOfLines));
+	});
+	
+	it(@"returns cached results for moved rects", ^{
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"Test string that will wrap over multiple lines when the width is small enough" attributes:nil name:nil];
+		CGRect clippingRect = CGRectZero;
+		CGRect bounds = CGRectMake(0, 0, 100, 640);
+		CGRect boundingRect = [layout boundingRectForProposedRect:bounds withClippingRect:&clippingRect containerRect:bounds];
+		CGRect firstLineRect = [[layout.lineRects firstObject] CGRectValue];
+		
+		CGRect movedBounds = CGRectMake(0, 21, 100, 619);
+		CGRect movedBoundingRect = [layout boundingRectForProposedRect:movedBounds withClippingRect:&clippingRect containerRect:bounds];
+		expect(@(CGRectEqualToRect(movedBoundingRect, CGRectOffset(boundingRect, 0, 21)))).to.beTruthy;
+		expect(@(CGRectEqualToRect([[layout.lineRects firstObject] CGRectValue], CGRectOffset(firstLineRect, 0, 21)))).to.beTruthy;
+	});
+	
+	it(@"reuses framesetters of previously used scale factors", ^{
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"A headline that should be scaled down" attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:30], PINCHTextLayoutMaximumNumberOfLinesAttribute : @1, PINCHTextLayoutMinimumScaleFactorAttribute : @0.3} name:nil];
+		CGRect clippingRect = CGRectZero;
+		CGRect narrowBounds = CGRectMake(0, 0, 300, 640);
+		CGRect wideBounds = CGRectMake(0, 0, 400, 640);
+		[layout boundingRectForProposedRect:narrowBounds withClippingRect:&clippingRect containerRect:narrowBounds];
+		CTFramesetterRef narrowFramesetter = layout.framesetter;
+		[layout boundingRectForProposedRect:wideBounds withClippingRect:&clippingRect containerRect:wideBounds];
+		[layout boundingRectForProposedRect:narrowBounds withClippingRect:&clippingRect containerRect:narrowBounds];
+		expect(layout.framesetter == narrowFramesetter).to.beTruthy;
+	});
+	
+	it(@"returns layout results that don't change with the layout", ^{
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"Test string that will wrap over multiple lines when the width is small enough" attributes:@{PINCHTextLayoutMaximumNumberOfLinesAttribute : @2, PINCHTextLayoutBreaksLastLineAttribute : @YES} name:nil];
+		CGRect clippingRect = CGRectZero;
+		CGRect bounds = CGRectMake(0, 0, 100, 640);
+		PINCHTextLayoutResult *result = [layout layoutResultForProposedRect:bounds withClippingRect:&clippingRect containerRect:bounds];
+		expect(layout.layoutResult).to.equal(result);
+		expect(@(result.numberOfLines)).to.equal(@2);
+		expect(@(result.isTruncated)).to.beTruthy;
+		expect(@([result.lineRanges count])).to.equal(@([result.lineRects count]));
+		
+		CGRect lastLineRect = [result.lineRects[1] CGRectValue];
+		expect(@(CGRectGetMaxX(lastLineRect))).to.beLessThanOrEqualTo(@(CGRectGetMaxX(bounds)));
+		
+		[layout invalidateLayoutCache];
+		expect(layout.layoutResult).to.beNil;
+		expect(@(result.numberOfLines)).to.equal(@2);
+		
+		PINCHTextLayoutResult *movedResult = [result layoutResultWithOffset:CGPointMake(0, 20)];
+		expect(@(CGRectEqualToRect(movedResult.boundingRect, CGRectOffset(result.boundingRect, 0, 20)))).to.beTruthy;
+		
+		// The attributes the result is drawn with are frozen as well
+		layout.underlined = YES;
+		layout.textInsets = UIEdgeInsetsMake(10, 10, 10, 10);
+		expect(result.drawingAttributes.underlined).to.beFalsy();
+		expect(result.drawingAttributes.breaksLastLine).to.beTruthy();
+		expect(movedResult.drawingAttributes.breaksLastLine).to.beTruthy();
+		expect(@(UIEdgeInsetsEqualToEdgeInsets(result.drawingAttributes.textInsets, UIEdgeInsetsZero))).to.beTruthy();
+	});
+	
+	it(@"draws a layout result with the links of the string it was measured with", ^{
+		NSString *string = @"Read [the article](http://www.justpinch.com/) or visit http://www.pinch.nl/ today";
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:string attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]} name:nil];
+		PINCHTestLinkDelegate *delegate = [[PINCHTestLinkDelegate alloc] init];
+		PINCHTextRenderer *renderer = [[PINCHTextRenderer alloc] init];
+		renderer.delegate = delegate;
+		[renderer addTextLayout:layout];
+		
+		CGRect clippingRect = CGRectZero;
+		CGRect bounds = CGRectMake(0, 0, 320, 640);
+		PINCHTextLayoutResult *result = [layout layoutResultForProposedRect:bounds withClippingRect:&clippingRect containerRect:bounds];
+		
+		// Data detected after measuring changes the links of the layout, not those of the result
+		layout.dataDetectorTypes = UIDataDetectorTypeLink;
+		NSUInteger detectedLocation = [[layout.attributedString string] rangeOfString:@"http://www.pinch.nl/"].location;
+		expect([layout.attributedString attribute:PINCHTextLayoutTextCheckingResultAttribute atIndex:detectedLocation effectiveRange:NULL]).willNot.beNil();
+		
+		UIGraphicsBeginImageContext(bounds.size);
+		{
+			[layout drawLayoutResult:result inContext:UIGraphicsGetCurrentContext()];
+		}
+		UIGraphicsEndImageContext();
+		
+		expect(delegate.encounteredValues).to.equal(@[[NSURL URLWithString:@"http://www.justpinch.com/"]]);
+	});
+	
 });
 
 describe(@"Rending of layouts", ^{
@@ -95,6 +326,781 @@ describe(@"Rending of layouts", ^{
 		expect(@(layout.actualNumberOfLines)).to.equal(@4);
 	});
 	
+	it(@"draws cached images of identical layouts", ^{
+		PINCHTextBitmapCache *bitmapCache = [[PINCHTextBitmapCache alloc] initWithByteLimit:1024 * 1024];
+		CGRect bounds = CGRectMake(0, 0, 320, 200);
+		
+		NSData *(^renderedBytes)(PINCHTextBitmapCache *) = ^NSData *(PINCHTextBitmapCache *cache) {
+			// A new renderer and layout every time, like a reused cell
+			PINCHTextRenderer *renderer = [[PINCHTextRenderer alloc] init];
+			renderer.bitmapCache = cache;
+			[renderer addTextLayout:[[PINCHTextLayout alloc] initWithString:@"Body text that is drawn in every [cell](http://www.justpinch.com/) of the feed" attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14], PINCHTextLayoutUnderlinedAttribute : @YES} name:nil]];
+			
+			NSData *bytes = nil;
+			UIGraphicsBeginImageContextWithOptions(bounds.size, NO, 2);
+			{
+				CGContextRef context = UIGraphicsGetCurrentContext();
+				[renderer renderTextLayoutsInContext:context withRect:bounds];
+				bytes = [NSData dataWithBytes:CGBitmapContextGetData(context) length:CGBitmapContextGetBytesPerRow(context) * CGBitmapContextGetHeight(context)];
+			}
+			UIGraphicsEndImageContext();
+			return bytes;
+		};
+		
+		NSData *drawnBytes = renderedBytes(nil);
+		
+		NSData *missedBytes = renderedBytes(bitmapCache);
+		expect(bitmapCache.missCount).to.equal(1);
+		expect(bitmapCache.hitCount).to.equal(0);
+		
+		NSData *cachedBytes = renderedBytes(bitmapCache);
+		expect(bitmapCache.missCount).to.equal(1);
+		expect(bitmapCache.hitCount).to.equal(1);
+		
+		// Pixel for pixel the same as drawing with CoreText, both when the image is rendered and when it's reused
+		expect(missedBytes).to.equal(drawnBytes);
+		expect(cachedBytes).to.equal(drawnBytes);
+	});
+	
+	it(@"draws without images unless a textView uses the bitmap cache", ^{
+		PINCHTextView *textView = [[PINCHTextView alloc] initWithFrame:CGRectMake(0, 0, 320, 100) textLayouts:@[]];
+		expect(textView.usesBitmapCache).to.beFalsy();
+		expect(textView.renderer.bitmapCache).to.beNil();
+		
+		textView.usesBitmapCache = YES;
+		expect(textView.renderer.bitmapCache).to.equal([PINCHTextBitmapCache sharedCache]);
+	});
+	
+	it(@"displays asynchronously with the links of the displayed image", ^{
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"This is an [URL](http://www.justpinch.com/) which should be tappable" attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:15]} name:nil];
+		PINCHTextView *textView = [[PINCHTextView alloc] initWithFrame:CGRectMake(0, 0, 320, 100) textLayouts:@[layout]];
+		textView.displaysAsynchronously = YES;
+		[textView.layer displayIfNeeded];
+		
+		// Nothing is drawn on the main thread
+		expect(textView.layer.contents).to.beNil();
+		expect(textView.layer.contents).willNot.beNil();
+		
+		// The link is on the first line
+		CGRect lineRect = [layout.lineRects[0] CGRectValue];
+		PINCHTextLink *link = nil;
+		for (CGFloat x = CGRectGetMinX(lineRect); x < CGRectGetMaxX(lineRect) && link == nil; x += 2)
+		{
+			link = [textView textLinkLinkAtPoint:CGPointMake(x, CGRectGetMidY(lineRect))];
+		}
+		expect(link.URL).to.equal([NSURL URLWithString:@"http://www.justpinch.com/"]);
+	});
+	
+	it(@"shows the textLayouts of the latest asynchronous display", ^{
+		NSDictionary *attributes = @{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:15]};
+		PINCHTextLayout *previousLayout = [[PINCHTextLayout alloc] initWithString:@"[Previous](http://www.justpinch.com/previous) link" attributes:attributes name:nil];
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"[Current](http://www.justpinch.com/current) link" attributes:attributes name:nil];
+		PINCHTextView *textView = [[PINCHTextView alloc] initWithFrame:CGRectMake(0, 0, 320, 100) textLayouts:@[previousLayout]];
+		textView.displaysAsynchronously = YES;
+		[textView.layer displayIfNeeded];
+		
+		// Cancels the display that is still rendering the previous textLayout
+		textView.renderer.textLayouts = @[layout];
+		[textView.layer displayIfNeeded];
+		expect(textView.layer.contents).willNot.beNil();
+		
+		CGRect lineRect = [layout.lineRects[0] CGRectValue];
+		PINCHTextLink *link = [textView textLinkLinkAtPoint:CGPointMake(CGRectGetMinX(lineRect) + 4, CGRectGetMidY(lineRect))];
+		expect(link.URL).to.equal([NSURL URLWithString:@"http://www.justpinch.com/current"]);
+	});
+	
+	it(@"measures a textLayout on the main thread while it's displayed asynchronously", ^{
+		NSDictionary *attributes = @{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:15], PINCHTextLayoutMinimumScaleFactorAttribute : @0.5, PINCHTextLayoutMaximumNumberOfLinesAttribute : @4};
+		NSString *string = @"A headline that is long enough to be scaled down to fit the number of lines, in a label as well as in the view";
+		CGRect (^measure)(PINCHTextLayout *, CGRect) = ^CGRect(PINCHTextLayout *layout, CGRect rect) {
+			CGRect clippingRect = CGRectZero;
+			return [layout boundingRectForProposedRect:rect withClippingRect:&clippingRect containerRect:rect];
+		};
+		CGRect viewRect = CGRectMake(0, 0, 320, 100);
+		CGRect labelRect = CGRectMake(0, 0, 160, 100000);
+		
+		PINCHTextLayout *referenceLayout = [[PINCHTextLayout alloc] initWithString:string attributes:attributes name:nil];
+		CGRect displayedReferenceRect = measure(referenceLayout, viewRect);
+		CGRect measuredReferenceRect = measure(referenceLayout, labelRect);
+		
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:string attributes:attributes name:nil];
+		PINCHTextView *textView = [[PINCHTextView alloc] initWithFrame:viewRect textLayouts:@[layout]];
+		textView.displaysAsynchronously = YES;
+		[textView.layer displayIfNeeded];
+		
+		// Measured like a label does, while the view renders the same textLayout in the background
+		CGRect measuredRect = measure(layout, labelRect);
+		expect(textView.layer.contents).willNot.beNil();
+		
+		expect([NSValue valueWithCGRect:measuredRect]).to.equal([NSValue valueWithCGRect:measuredReferenceRect]);
+		expect([NSValue valueWithCGRect:measure(layout, viewRect)]).to.equal([NSValue valueWithCGRect:displayedReferenceRect]);
+	});
+	
+	it(@"calls the delegate after rendering for asynchronous display", ^{
+		PINCHTestLinkDelegate *delegate = [[PINCHTestLinkDelegate alloc] init];
+		PINCHTextRenderer *renderer = [[PINCHTextRenderer alloc] init];
+		renderer.delegate = delegate;
+		[renderer addTextLayout:[[PINCHTextLayout alloc] initWithString:@"This is an [URL](http://www.justpinch.com/) which should be tappable" attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:15]} name:nil]];
+		
+		NSArray *delegateCalls = nil;
+		UIImage *image = [renderer imageOfTextLayouts:renderer.textLayouts withSize:CGSizeMake(320, 100) scale:1 cancelToken:[[PINCHTextPrefetchToken alloc] init] delegateCalls:&delegateCalls];
+		expect(image).toNot.beNil();
+		expect(delegate.numberOfDeliveries).to.equal(0);
+		
+		for (void(^delegateCall)(void) in delegateCalls)
+		{
+			delegateCall();
+		}
+		expect(delegate.numberOfDeliveries).to.equal(1);
+		expect(delegate.links.count).to.equal(1);
+		
+		// A cancelled render has no image and nothing to call
+		PINCHTextPrefetchToken *cancelToken = [[PINCHTextPrefetchToken alloc] init];
+		[cancelToken cancel];
+		delegateCalls = nil;
+		image = [renderer imageOfTextLayouts:renderer.textLayouts withSize:CGSizeMake(320, 100) scale:1 cancelToken:cancelToken delegateCalls:&delegateCalls];
+		expect(image).to.beNil();
+		expect(delegateCalls).to.beNil();
+	});
+	
+	it(@"leaves gaps in underlines where glyphs descend", ^{
+		CGRect bounds = CGRectMake(0, 0, 320, 60);
+		
+		// The number of pixels the underline adds to a string of equally wide glyphs
+		NSInteger(^underlinePixels)(NSString *) = ^NSInteger(NSString *string) {
+			NSInteger(^drawnPixels)(BOOL) = ^NSInteger(BOOL underlined) {
+				PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:string attributes:@{PINCHTextLayoutFontAttribute : [UIFont fontWithName:@"Courier" size:24], PINCHTextLayoutUnderlinedAttribute : @(underlined)} name:nil];
+				CGRect clippingRect = CGRectZero;
+				CGRect rect = [layout boundingRectForProposedRect:bounds withClippingRect:&clippingRect containerRect:bounds];
+				
+				NSInteger pixels = 0;
+				UIGraphicsBeginImageContextWithOptions(bounds.size, NO, 1);
+				{
+					CGContextRef context = UIGraphicsGetCurrentContext();
+					[layout drawInContext:context withRect:rect clippingRect:clippingRect];
+					const uint8_t *data = CGBitmapContextGetData(context);
+					size_t bytesPerRow = CGBitmapContextGetBytesPerRow(context);
+					for (size_t row = 0; row < CGBitmapContextGetHeight(context); row++)
+					{
+						for (size_t column = 0; column < CGBitmapContextGetWidth(context); column++)
+						{
+							// Premultiplied, so only fully transparent pixels are zero
+							pixels += (*(const uint32_t *)(data + row * bytesPerRow + column * 4) != 0);
+						}
+					}
+				}
+				UIGraphicsEndImageContext();
+				return pixels;
+			};
+			return drawnPixels(YES) - drawnPixels(NO);
+		};
+		
+		NSInteger straightPixels = underlinePixels(@"xxxxxxxx");
+		NSInteger descendingPixels = underlinePixels(@"gggggggg");
+		expect(straightPixels).to.beGreaterThan(0);
+		expect(descendingPixels).to.beGreaterThan(0);
+		expect(descendingPixels).to.beLessThan(straightPixels);
+	});
+	
+	it(@"delivers the links of a background render at once", ^{
+		NSMutableString *string = [NSMutableString string];
+		NSUInteger numberOfLinks = 60;
+		for (NSUInteger index = 0; index < numberOfLinks; index++)
+		{
+			[string appendFormat:@"Footnote [number %lu](http://www.justpinch.com/%lu) ", (unsigned long)index, (unsigned long)index];
+		}
+		PINCHTestLinkDelegate *delegate = [[PINCHTestLinkDelegate alloc] init];
+		PINCHTextRenderer *renderer = [[PINCHTextRenderer alloc] init];
+		renderer.delegate = delegate;
+		[renderer addTextLayout:[[PINCHTextLayout alloc] initWithString:string attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]} name:nil]];
+		
+		dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+			CGSize size = CGSizeMake(200, 2000);
+			CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+			CGContextRef context = CGBitmapContextCreate(NULL, (size_t)size.width, (size_t)size.height, 8, 0, colorSpace, kCGImageAlphaPremultipliedFirst);
+			CGColorSpaceRelease(colorSpace);
+			CGContextTranslateCTM(context, 0, size.height);
+			CGContextScaleCTM(context, 1, -1);
+			[renderer renderTextLayoutsInContext:context withRect:(CGRect){CGPointZero, size}];
+			CGContextRelease(context);
+		});
+		
+		expect(delegate.numberOfDeliveries).will.equal(1);
+		expect(delegate.links.count).to.equal(numberOfLinks);
+		
+		// Links that wrap over two lines are delivered as one link with both rects
+		NSUInteger numberOfRects = 0;
+		for (PINCHTextLink *link in delegate.links)
+		{
+			expect(link.URL).toNot.beNil();
+			numberOfRects += PINCHTextLinkGetRects(link, NULL, NULL);
+		}
+		expect(numberOfRects).to.beGreaterThanOrEqualTo(numberOfLinks);
+	});
+	
+	it(@"draws measured lines like freshly typeset lines", ^{
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"Test string that will wrap over multiple lines when the width is small enough" attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:15]} name:nil];
+		CGRect bounds = CGRectMake(0, 0, 120, 320);
+		CGRect proposedRect = CGRectMake(10, 20, 100, 300);
+		
+		NSData *(^drawnData)(BOOL) = ^NSData *(BOOL measured) {
+			CGRect clippingRect = CGRectZero;
+			CGRect boundingRect = [layout boundingRectForProposedRect:proposedRect withClippingRect:&clippingRect containerRect:bounds];
+			if (!measured)
+			{
+				// Without a measured layout the string is typeset again when drawing
+				[layout invalidateLayoutCache];
+			}
+			UIImage *image = nil;
+			UIGraphicsBeginImageContext(bounds.size);
+			{
+				[layout drawInContext:UIGraphicsGetCurrentContext() withRect:boundingRect clippingRect:clippingRect];
+				image = UIGraphicsGetImageFromCurrentImageContext();
+			}
+			UIGraphicsEndImageContext();
+			return UIImagePNGRepresentation(image);
+		};
+		
+		expect(drawnData(YES)).to.equal(drawnData(NO));
+	});
+	
+});
+
+describe(@"Performance", ^{
+	
+	NSString *(^bodyString)(NSUInteger) = ^NSString *(NSUInteger numberOfSentences) {
+		NSMutableString *string = [NSMutableString string];
+		for (NSUInteger index = 0; index < numberOfSentences; index++)
+		{
+			[string appendFormat:@"Sentence number %lu of a body text that is measured in the performance tests. ", (unsigned long)index];
+		}
+		return string;
+	};
+	
+	it(@"measures independent layouts concurrently", ^{
+		NSUInteger numberOfLayouts = 8;
+		NSUInteger numberOfWidths = 20;
+		NSMutableArray *layouts = [NSMutableArray array];
+		for (NSUInteger index = 0; index < numberOfLayouts; index++)
+		{
+			[layouts addObject:[[PINCHTestTypesettingLayout alloc] initWithString:bodyString(20 + index) attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]} name:nil]];
+		}
+		
+		NSArray *(^measureLayout)(PINCHTextLayout *) = ^NSArray *(PINCHTextLayout *layout) {
+			NSMutableArray *rects = [NSMutableArray arrayWithCapacity:numberOfWidths];
+			for (NSUInteger widthIndex = 0; widthIndex < numberOfWidths; widthIndex++)
+			{
+				CGRect bounds = CGRectMake(0, 0, 200 + widthIndex, 10000);
+				CGRect clippingRect = CGRectZero;
+				[rects addObject:[NSValue valueWithCGRect:[layout boundingRectForProposedRect:bounds withClippingRect:&clippingRect containerRect:bounds]]];
+			}
+			return rects;
+		};
+		
+		NSMutableArray *concurrentRects = [NSMutableArray arrayWithCapacity:numberOfLayouts];
+		for (NSUInteger index = 0; index < numberOfLayouts; index++)
+		{
+			[concurrentRects addObject:[NSNull null]];
+		}
+		dispatch_apply(numberOfLayouts, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+			NSArray *rects = measureLayout(layouts[index]);
+			@synchronized(concurrentRects)
+			{
+				concurrentRects[index] = rects;
+			}
+		});
+		
+		for (NSUInteger index = 0; index < numberOfLayouts; index++)
+		{
+			PINCHTestTypesettingLayout *layout = layouts[index];
+			// Every width is typeset with the one framesetter of the layout, none is shared with the other threads
+			expect([layout.framesetters count]).to.equal(1);
+			
+			// Typesetting the same layout again on one thread gives the same rects
+			[layout invalidateLayoutCache];
+			expect(measureLayout(layout)).to.equal(concurrentRects[index]);
+		}
+	});
+	
+	it(@"measures a feed of renderers in a batch", ^{
+		NSUInteger numberOfItems = 1000;
+		NSArray *(^feedRenderers)(void) = ^NSArray *{
+			NSMutableArray *textRenderers = [NSMutableArray arrayWithCapacity:numberOfItems];
+			for (NSUInteger index = 0; index < numberOfItems; index++)
+			{
+				PINCHTextRenderer *textRenderer = [[PINCHTextRenderer alloc] init];
+				[textRenderer addTextLayout:[[PINCHTestTypesettingLayout alloc] initWithString:[NSString stringWithFormat:@"Headline of feed item %lu", (unsigned long)index] attributes:@{PINCHTextLayoutFontAttribute : [UIFont boldSystemFontOfSize:20], PINCHTextLayoutMaximumNumberOfLinesAttribute : @2} name:@"title"]];
+				[textRenderer addTextLayout:[[PINCHTestTypesettingLayout alloc] initWithString:bodyString(1 + (index % 5)) attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]} name:@"body"]];
+				[textRenderers addObject:textRenderer];
+			}
+			return textRenderers;
+		};
+		NSArray *widths = @[@300];
+		
+		NSArray *serialRenderers = feedRenderers();
+		NSMutableArray *serialRects = [NSMutableArray arrayWithCapacity:numberOfItems];
+		for (PINCHTextRenderer *textRenderer in serialRenderers)
+		{
+			[serialRects addObject:[NSValue valueWithCGRect:[textRenderer boundingRectForLayoutsInProposedRect:CGRectMake(0, 0, 300, CGFLOAT_MAX)]]];
+		}
+		
+		// The rects come back in the order of the renderers, whichever worker measured them
+		NSArray *batchRenderers = feedRenderers();
+		NSArray *batchRects = [PINCHTextRenderer boundingRectsForTextRenderers:batchRenderers withWidths:widths];
+		expect(batchRects).to.equal(serialRects);
+		
+		// Every layout has been measured once, with the result applied to the layout itself
+		for (NSUInteger index = 0; index < numberOfItems; index++)
+		{
+			for (PINCHTestTypesettingLayout *textLayout in [batchRenderers[index] textLayouts])
+			{
+				expect(textLayout.layoutResult).toNot.beNil();
+				expect([textLayout.framesetters count]).to.equal(1);
+			}
+		}
+		
+		// Widths are given per renderer as well
+		NSArray *textLayouts = [[serialRenderers[0] textLayouts] copy];
+		NSArray *layoutRects = [PINCHTextRenderer boundingRectsForTextLayouts:textLayouts withWidths:@[@300, @150]];
+		expect([layoutRects count]).to.equal(2);
+		expect(CGRectGetWidth([layoutRects[1] CGRectValue])).to.beLessThanOrEqualTo(150);
+	});
+	
+	it(@"prefetches layouts and drops requests for stale widths", ^{
+		PINCHTextPrefetcher *prefetcher = [[PINCHTextPrefetcher alloc] init];
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:bodyString(50) attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]} name:nil];
+		
+		__block NSUInteger numberOfStaleCompletions = 0;
+		__block NSValue *prefetchedRect = nil;
+		PINCHTextPrefetchToken *staleToken = [prefetcher prefetchTextLayout:layout width:200 priority:NSOperationQueuePriorityLow completion:^(CGRect boundingRect) {
+			numberOfStaleCompletions++;
+		}];
+		[prefetcher prefetchTextLayout:layout width:300 priority:NSOperationQueuePriorityVeryHigh completion:^(CGRect boundingRect) {
+			prefetchedRect = [NSValue valueWithCGRect:boundingRect];
+		}];
+		
+		expect(staleToken.isCancelled).to.beTruthy();
+		expect(prefetchedRect).willNot.beNil();
+		expect(numberOfStaleCompletions).to.equal(0);
+		
+		// Drawing in the prefetched width finds the result in the layout cache
+		CGRect clippingRect = CGRectZero;
+		CGRect rect = CGRectMake(0, 0, 300, 100000);
+		CGRect boundingRect = [layout boundingRectForProposedRect:rect withClippingRect:&clippingRect containerRect:rect];
+		expect([NSValue valueWithCGRect:boundingRect]).to.equal(prefetchedRect);
+	});
+	
+	it(@"measures a layout on the main thread while it's being prefetched", ^{
+		NSDictionary *attributes = @{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14], PINCHTextLayoutMinimumScaleFactorAttribute : @0.5, PINCHTextLayoutMaximumNumberOfLinesAttribute : @8};
+		PINCHTextLayoutResult *(^measure)(PINCHTextLayout *, CGFloat) = ^PINCHTextLayoutResult *(PINCHTextLayout *layout, CGFloat width) {
+			CGRect clippingRect = CGRectZero;
+			CGRect rect = CGRectMake(0, 0, width, 100000);
+			return [layout layoutResultForProposedRect:rect withClippingRect:&clippingRect containerRect:rect];
+		};
+		
+		PINCHTextLayout *referenceLayout = [[PINCHTextLayout alloc] initWithString:bodyString(30) attributes:attributes name:nil];
+		PINCHTextLayoutResult *prefetchedReference = measure(referenceLayout, 300);
+		PINCHTextLayoutResult *measuredReference = measure(referenceLayout, 200);
+		
+		// Both measurements search the scale factor of the same layout, one of them on the queue of the prefetcher
+		PINCHTextPrefetcher *prefetcher = [[PINCHTextPrefetcher alloc] init];
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:bodyString(30) attributes:attributes name:nil];
+		__block NSValue *prefetchedRect = nil;
+		[prefetcher prefetchTextLayout:layout width:300 priority:NSOperationQueuePriorityVeryHigh completion:^(CGRect boundingRect) {
+			prefetchedRect = [NSValue valueWithCGRect:boundingRect];
+		}];
+		PINCHTextLayoutResult *measured = measure(layout, 200);
+		expect(prefetchedRect).willNot.beNil();
+		
+		expect(measured.scaleFactor).to.equal(measuredReference.scaleFactor);
+		expect(measured.numberOfLines).to.equal(measuredReference.numberOfLines);
+		expect([NSValue valueWithCGRect:measured.boundingRect]).to.equal([NSValue valueWithCGRect:measuredReference.boundingRect]);
+		expect(prefetchedRect).to.equal([NSValue valueWithCGRect:prefetchedReference.boundingRect]);
+		
+		// The results of both measurements are in the layout cache
+		PINCHTextLayoutResult *prefetched = measure(layout, 300);
+		expect(prefetched.scaleFactor).to.equal(prefetchedReference.scaleFactor);
+		expect([NSValue valueWithCGRect:prefetched.boundingRect]).to.equal(prefetchedRect);
+	});
+	
+	it(@"measures from the persistent cache after a cold start", ^{
+		NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"PINCHTextMeasurementCacheSpec"]];
+		[[NSFileManager defaultManager] removeItemAtURL:fileURL error:NULL];
+		
+		NSUInteger numberOfLayouts = 500;
+		NSArray *(^articleLayouts)(void) = ^NSArray *{
+			NSMutableArray *layouts = [NSMutableArray arrayWithCapacity:numberOfLayouts];
+			for (NSUInteger index = 0; index < numberOfLayouts; index++)
+			{
+				NSString *string = [NSString stringWithFormat:@"Article %lu. %@", (unsigned long)index, bodyString(1 + (index % 10))];
+				[layouts addObject:[[PINCHTestTypesettingLayout alloc] initWithString:string attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14], PINCHTextLayoutMinimumScaleFactorAttribute : @0.5, PINCHTextLayoutMaximumNumberOfLinesAttribute : @6} name:nil]];
+			}
+			return layouts;
+		};
+		NSArray *(^measure)(NSArray *) = ^NSArray *(NSArray *layouts) {
+			NSMutableArray *rects = [NSMutableArray arrayWithCapacity:[layouts count]];
+			for (PINCHTextLayout *layout in layouts)
+			{
+				CGRect clippingRect = CGRectZero;
+				CGRect rect = CGRectMake(0, 0, 300, 100000);
+				[rects addObject:[NSValue valueWithCGRect:[layout boundingRectForProposedRect:rect withClippingRect:&clippingRect containerRect:rect]]];
+			}
+			return rects;
+		};
+		
+		[PINCHTextMeasurementCache setDefaultCache:[[PINCHTextMeasurementCache alloc] initWithFileURL:fileURL maximumFileSize:1024 * 1024]];
+		NSArray *typesetLayouts = articleLayouts();
+		NSArray *typesetRects = measure(typesetLayouts);
+		[[PINCHTextMeasurementCache defaultCache] synchronize];
+		
+		// A new cache instance and new layouts, like after launching again
+		[PINCHTextMeasurementCache setDefaultCache:[[PINCHTextMeasurementCache alloc] initWithFileURL:fileURL maximumFileSize:1024 * 1024]];
+		NSArray *layouts = articleLayouts();
+		NSArray *persistedRects = measure(layouts);
+		[PINCHTextMeasurementCache setDefaultCache:nil];
+		expect(persistedRects).to.equal(typesetRects);
+		
+		// Fitting the scale factor typesets at several scales, a persisted measurement only typesets its lines once
+		NSUInteger numberOfTypesettingFramesetters = 0;
+		for (NSUInteger index = 0; index < numberOfLayouts; index++)
+		{
+			PINCHTestTypesettingLayout *typesetLayout = typesetLayouts[index];
+			PINCHTestTypesettingLayout *layout = layouts[index];
+			numberOfTypesettingFramesetters += [typesetLayout.framesetters count];
+			expect([layout.framesetters count]).to.equal(1);
+			
+			// The lines are there without drawing first
+			expect(layout.layoutResult.numberOfLines).to.beGreaterThan(0);
+			expect(layout.layoutResult.lineRects).to.equal(typesetLayout.layoutResult.lineRects);
+			expect(layout.lineRects).to.equal(typesetLayout.lineRects);
+		}
+		expect(numberOfTypesettingFramesetters).to.beGreaterThan(numberOfLayouts);
+		
+		// A corrupt file is discarded instead of returning garbage
+		NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingAtPath:[fileURL path]];
+		[fileHandle writeData:[@"corrupt" dataUsingEncoding:NSUTF8StringEncoding]];
+		[fileHandle closeFile];
+		PINCHTextMeasurementCache *reopenedCache = [[PINCHTextMeasurementCache alloc] initWithFileURL:fileURL maximumFileSize:1024 * 1024];
+		PINCHTextLayout *layout = articleLayouts()[0];
+		[PINCHTextMeasurementCache setDefaultCache:reopenedCache];
+		NSArray *rects = measure(@[layout]);
+		[PINCHTextMeasurementCache setDefaultCache:nil];
+		expect(rects[0]).to.equal(typesetRects[0]);
+		expect([layout.layoutResult.lineRects count]).to.beGreaterThan(0);
+		[[NSFileManager defaultManager] removeItemAtURL:fileURL error:NULL];
+	});
+	
+	it(@"renders offscreen images concurrently like the main thread", ^{
+		// One renderer with the same textLayouts for every thread, so the renders share their caches
+		PINCHTextRenderer *renderer = [[PINCHTextRenderer alloc] init];
+		[renderer addTextLayout:[[PINCHTextLayout alloc] initWithString:@"Headline of the article" attributes:@{PINCHTextLayoutFontAttribute : [UIFont boldSystemFontOfSize:20]} name:@"title"]];
+		[renderer addTextLayout:[[PINCHTextLayout alloc] initWithString:bodyString(4) attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14], PINCHTextLayoutUnderlinedAttribute : @YES} name:@"body"]];
+		CGSize size = CGSizeMake(320, 400);
+		CGFloat scale = 2;
+		
+		UIImage *mainThreadImage = nil;
+		UIGraphicsBeginImageContextWithOptions(size, NO, scale);
+		{
+			[renderer renderTextLayoutsInContext:UIGraphicsGetCurrentContext() withRect:(CGRect){CGPointZero, size}];
+			mainThreadImage = UIGraphicsGetImageFromCurrentImageContext();
+		}
+		UIGraphicsEndImageContext();
+		NSData *mainThreadData = UIImagePNGRepresentation(mainThreadImage);
+		
+		NSUInteger numberOfRenders = 64;
+		NSMutableArray *renderedData = [NSMutableArray arrayWithCapacity:numberOfRenders];
+		for (NSUInteger index = 0; index < numberOfRenders; index++)
+		{
+			[renderedData addObject:[NSNull null]];
+		}
+		dispatch_apply(numberOfRenders, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t index) {
+			UIImage *image = [renderer imageOfTextLayoutsWithSize:size scale:scale];
+			NSData *data = UIImagePNGRepresentation(image);
+			@synchronized(renderedData)
+			{
+				renderedData[index] = data;
+			}
+		});
+		
+		for (NSData *data in renderedData)
+		{
+			expect(data).to.equal(mainThreadData);
+		}
+	});
+	
+	it(@"underlines all lines of a layout at once like line by line", ^{
+		CGSize size = CGSizeMake(320, 640);
+		NSData *(^drawnBytes)(Class, BOOL) = ^NSData *(Class layoutClass, BOOL underlined) {
+			PINCHTextLayout *layout = [[layoutClass alloc] initWithString:bodyString(8) attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14], PINCHTextLayoutUnderlinedAttribute : @(underlined)} name:nil];
+			CGRect clippingRect = CGRectZero;
+			CGRect rect = [layout boundingRectForProposedRect:(CGRect){CGPointZero, size} withClippingRect:&clippingRect containerRect:(CGRect){CGPointZero, size}];
+			expect(layout.actualNumberOfLines).to.beGreaterThanOrEqualTo(10);
+			
+			NSData *bytes = nil;
+			UIGraphicsBeginImageContextWithOptions(size, NO, 3);
+			{
+				CGContextRef context = UIGraphicsGetCurrentContext();
+				[layout drawInContext:context withRect:rect clippingRect:clippingRect];
+				bytes = [NSData dataWithBytes:CGBitmapContextGetData(context) length:CGBitmapContextGetBytesPerRow(context) * CGBitmapContextGetHeight(context)];
+			}
+			UIGraphicsEndImageContext();
+			return bytes;
+		};
+		
+		NSData *underlinedBytes = drawnBytes([PINCHTextLayout class], YES);
+		expect(underlinedBytes).toNot.equal(drawnBytes([PINCHTextLayout class], NO));
+		expect(underlinedBytes).to.equal(drawnBytes([PINCHTestLineByLineUnderlineLayout class], YES));
+	});
+	
+	it(@"redraws hyphenated and justified lines without creating them again", ^{
+		NSString *string = [bodyString(20) stringByReplacingOccurrencesOfString:@"measured" withString:@"mea\u00ADsured"];
+		string = [string stringByReplacingOccurrencesOfString:@"performance" withString:@"per\u00ADfor\u00ADmance"];
+		PINCHTestTypesettingLayout *layout = [[PINCHTestTypesettingLayout alloc] initWithString:string attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14], PINCHTextLayoutHyphenatedAttribute : @YES, PINCHTextLayoutTextAlignmentAttribute : @(NSTextAlignmentJustified)} name:nil];
+		CGSize size = CGSizeMake(200, 2000);
+		CGRect clippingRect = CGRectZero;
+		CGRect rect = [layout boundingRectForProposedRect:CGRectMake(0, 0, size.width, size.height) withClippingRect:&clippingRect containerRect:(CGRect){CGPointZero, size}];
+		
+		NSData *(^drawnBytes)(NSUInteger) = ^NSData *(NSUInteger draws) {
+			NSData *bytes = nil;
+			UIGraphicsBeginImageContextWithOptions(size, NO, 1);
+			{
+				CGContextRef context = UIGraphicsGetCurrentContext();
+				for (NSUInteger index = 0; index < draws; index++)
+				{
+					CGContextClearRect(context, (CGRect){CGPointZero, size});
+					[layout drawInContext:context withRect:rect clippingRect:clippingRect];
+				}
+				bytes = [NSData dataWithBytes:CGBitmapContextGetData(context) length:CGBitmapContextGetBytesPerRow(context) * CGBitmapContextGetHeight(context)];
+			}
+			UIGraphicsEndImageContext();
+			return bytes;
+		};
+		
+		NSData *firstBytes = drawnBytes(1);
+		NSArray *createdLines = [layout.hyphenatedLines copy];
+		expect([createdLines count]).to.beGreaterThan(0);
+		[layout.hyphenatedLines removeAllObjects];
+		
+		// Every redraw gets the very lines of the first draw, which draw exactly like they did then
+		NSData *redrawnBytes = drawnBytes(10);
+		expect([layout.hyphenatedLines count]).to.beGreaterThan(0);
+		for (id line in layout.hyphenatedLines)
+		{
+			expect([createdLines indexOfObjectIdenticalTo:line]).toNot.equal(NSNotFound);
+		}
+		expect(redrawnBytes).to.equal(firstBytes);
+	});
+	
+	it(@"truncates the last line of a short and a long text alike", ^{
+		CGSize size = CGSizeMake(320, 640);
+		NSData *(^drawnBytes)(NSUInteger, NSDictionary *) = ^NSData *(NSUInteger numberOfSentences, NSDictionary *textAttributes) {
+			NSMutableDictionary *attributes = [@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14], PINCHTextLayoutMaximumNumberOfLinesAttribute : @2, PINCHTextLayoutBreaksLastLineAttribute : @YES} mutableCopy];
+			[attributes addEntriesFromDictionary:textAttributes];
+			PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:bodyString(numberOfSentences) attributes:attributes name:nil];
+			CGRect clippingRect = CGRectZero;
+			CGRect rect = [layout boundingRectForProposedRect:CGRectMake(0, 0, size.width, size.height) withClippingRect:&clippingRect containerRect:(CGRect){CGPointZero, size}];
+			expect(layout.actualNumberOfLines).to.equal(2);
+			
+			NSData *bytes = nil;
+			UIGraphicsBeginImageContextWithOptions(size, NO, 1);
+			{
+				CGContextRef context = UIGraphicsGetCurrentContext();
+				[layout drawInContext:context withRect:rect clippingRect:clippingRect];
+				bytes = [NSData dataWithBytes:CGBitmapContextGetData(context) length:CGBitmapContextGetBytesPerRow(context) * CGBitmapContextGetHeight(context)];
+			}
+			UIGraphicsEndImageContext();
+			return bytes;
+		};
+		
+		// A teaser of a short text and of a 20 KB article, only a window of the article is typeset to truncate it
+		expect(drawnBytes(250, nil)).to.equal(drawnBytes(4, nil));
+		
+		// The ellipsis has the attributes of the text it replaces
+		NSDictionary *textAttributes = @{PINCHTextLayoutKerningAttribute : @2, PINCHTextLayoutTextColorAttribute : [UIColor redColor]};
+		NSData *attributedBytes = drawnBytes(4, textAttributes);
+		expect(attributedBytes).toNot.equal(drawnBytes(4, nil));
+		expect(drawnBytes(250, textAttributes)).to.equal(attributedBytes);
+	});
+	
+	it(@"measures capped previews by typesetting only their first lines", ^{
+		NSDictionary *attributes = @{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14], PINCHTextLayoutMaximumNumberOfLinesAttribute : @3, PINCHTextLayoutBreaksLastLineAttribute : @YES};
+		PINCHTextLayout *shortLayout = [[PINCHTextLayout alloc] initWithString:bodyString(10) attributes:attributes name:nil];
+		PINCHTextLayout *longLayout = [[PINCHTextLayout alloc] initWithString:bodyString(500) attributes:attributes name:nil];
+		
+		CGRect proposedRect = CGRectMake(0, 0, 320, 1000);
+		CGRect clippingRect = CGRectZero;
+		PINCHTextLayoutResult *shortResult = [shortLayout layoutResultForProposedRect:proposedRect withClippingRect:&clippingRect containerRect:proposedRect];
+		PINCHTextLayoutResult *longResult = [longLayout layoutResultForProposedRect:proposedRect withClippingRect:&clippingRect containerRect:proposedRect];
+		
+		// Both texts are capped at the maximum number of lines and truncated, however long the rest is
+		for (PINCHTextLayoutResult *result in @[shortResult, longResult])
+		{
+			expect(result.numberOfLines).to.equal(3);
+			expect(result.fitsProposedRect).to.beFalsy();
+			expect(result.isTruncated).to.beTruthy();
+		}
+		
+		// The first lines of both texts are the same, so are their sizes and the ranges they're typeset from
+		expect(NSStringFromCGRect(longResult.boundingRect)).to.equal(NSStringFromCGRect(shortResult.boundingRect));
+		expect(longResult.lineRects).to.equal(shortResult.lineRects);
+		expect(longResult.lineRanges).to.equal(shortResult.lineRanges);
+	});
+	
+	it(@"finds links in dense text like testing every link", ^{
+		// A tag cloud of short links on lines closer than the touch regions, so regions overlap other links
+		NSMutableArray *URLLinks = [NSMutableArray array];
+		NSMutableArray *resultLinks = [NSMutableArray array];
+		NSUInteger numberOfRects = 0;
+		for (NSUInteger index = 0; index < 400; index++)
+		{
+			CGRect rect = CGRectMake((index % 10) * 32, (index / 10) * 18, 24, 14);
+			numberOfRects++;
+			if (index % 3 == 0)
+			{
+				NSTextCheckingResult *result = [NSTextCheckingResult linkCheckingResultWithRange:NSMakeRange(index, 1) URL:[NSURL URLWithString:@"http://www.justpinch.com/"]];
+				[resultLinks addObject:[[PINCHTextLink alloc] initWithTextCheckingResult:result rect:rect]];
+			}
+			else
+			{
+				PINCHTextLink *link = [[PINCHTextLink alloc] initWithURL:[NSURL URLWithString:@"http://www.justpinch.com/"] range:NSMakeRange(index, 1) rect:rect];
+				if (index % 7 == 0)
+				{
+					// Links that wrap onto the next line
+					[link addRect:CGRectOffset(rect, 0, 18)];
+					numberOfRects++;
+				}
+				[URLLinks addObject:link];
+			}
+		}
+		
+		// The order textLinks used to be tested in
+		PINCHTextLink *(^linearLinkAtPoint)(CGPoint) = ^PINCHTextLink *(CGPoint point) {
+			for (NSArray *links in @[URLLinks, resultLinks])
+			{
+				for (PINCHTextLink *link in links)
+				{
+					if ([link containsPoint:point])
+					{
+						return link;
+					}
+				}
+			}
+			for (NSArray *links in @[URLLinks, resultLinks])
+			{
+				for (PINCHTextLink *link in links)
+				{
+					if ([link touchRegionContainsPoint:point])
+					{
+						return link;
+					}
+				}
+			}
+			return nil;
+		};
+		
+		PINCHTextLinkIndex *linkIndex = [[PINCHTextLinkIndex alloc] initWithLinkGroups:@[URLLinks, resultLinks]];
+		// Rects are kept once for every band they overlap
+		expect(linkIndex.numberOfRects).to.beGreaterThanOrEqualTo(numberOfRects);
+		
+		NSUInteger numberOfMismatches = 0;
+		// Off the whole points, where paths and rects may disagree about their edges
+		for (CGFloat y = -30.25; y < 760; y += 1.5)
+		{
+			for (CGFloat x = -4.25; x < 324; x += 3.5)
+			{
+				CGPoint point = CGPointMake(x, y);
+				numberOfMismatches += ([linkIndex linkAtPoint:point] != linearLinkAtPoint(point));
+			}
+		}
+		expect(numberOfMismatches).to.equal(0);
+	});
+	
+	it(@"parses every markdown link of a long string", ^{
+		NSMutableString *string = [NSMutableString string];
+		NSUInteger numberOfLinks = 4000;
+		for (NSUInteger index = 0; index < numberOfLinks; index++)
+		{
+			[string appendFormat:@"Sentence %lu has [footnote %lu](http://www.justpinch.com/%lu) in it. ", (unsigned long)index, (unsigned long)index, (unsigned long)index];
+		}
+		
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:string attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]} name:nil];
+		NSAttributedString *attributedString = layout.attributedString;
+		expect([attributedString.string rangeOfString:@"]("].location).to.equal(NSNotFound);
+		
+		__block NSUInteger numberOfParsedLinks = 0;
+		[attributedString enumerateAttribute:PINCHTextLayoutURLStringAttribute inRange:NSMakeRange(0, attributedString.length) options:0 usingBlock:^(id value, NSRange range, BOOL *stop) {
+			numberOfParsedLinks += (value != nil);
+		}];
+		expect(numberOfParsedLinks).to.equal(numberOfLinks);
+	});
+	
+	it(@"reads line geometry from one buffer without allocating per line", ^{
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:bodyString(200) attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]} name:nil];
+		CGRect bounds = CGRectMake(0, 0, 320, 100000);
+		CGRect clippingRect = CGRectZero;
+		PINCHTextLayoutResult *result = [layout layoutResultForProposedRect:bounds withClippingRect:&clippingRect containerRect:bounds];
+		
+		const PINCHTextLayoutLine *lines = NULL;
+		NSUInteger numberOfLines = PINCHTextLayoutResultGetLines(result, &lines);
+		expect(numberOfLines).to.beGreaterThan(100);
+		expect(numberOfLines).to.equal(result.numberOfLines);
+		expect(PINCHTextLayoutResultGetLines(nil, NULL)).to.equal(0);
+		
+		// Every call points into the same buffer of the result, nothing is copied or created
+		const PINCHTextLayoutLine *sameLines = NULL;
+		expect(PINCHTextLayoutResultGetLines(result, &sameLines)).to.equal(numberOfLines);
+		expect(sameLines == lines).to.beTruthy();
+		
+		// The boxed values are created from the buffer, the lines follow each other in the string
+		NSUInteger location = 0;
+		for (NSUInteger lineIndex = 0; lineIndex < numberOfLines; lineIndex++)
+		{
+			expect(NSStringFromCGRect([result.lineRects[lineIndex] CGRectValue])).to.equal(NSStringFromCGRect(lines[lineIndex].rect));
+			expect(NSStringFromCGPoint([result.lineOrigins[lineIndex] CGPointValue])).to.equal(NSStringFromCGPoint(lines[lineIndex].origin));
+			expect(NSStringFromRange([result.lineRanges[lineIndex] rangeValue])).to.equal(NSStringFromRange(lines[lineIndex].range));
+			expect(lines[lineIndex].range.location).to.equal(location);
+			location = NSMaxRange(lines[lineIndex].range);
+		}
+		expect(location).to.equal(result.attributedString.length);
+		
+		// A moved result has its own buffer, the buffer of the original result stays as it was
+		CGRect firstLineRect = lines[0].rect;
+		PINCHTextLayoutResult *movedResult = [result layoutResultWithOffset:CGPointMake(0, 100)];
+		const PINCHTextLayoutLine *movedLines = NULL;
+		expect(PINCHTextLayoutResultGetLines(movedResult, &movedLines)).to.equal(numberOfLines);
+		expect(movedLines == lines).to.beFalsy();
+		expect(NSStringFromCGRect(movedLines[0].rect)).to.equal(NSStringFromCGRect(CGRectOffset(firstLineRect, 0, 100)));
+		expect(NSStringFromCGRect(lines[0].rect)).to.equal(NSStringFromCGRect(firstLineRect));
+	});
+	
+	it(@"hyphenates a long text like its words one at a time", ^{
+		PINCHTextHyphenator *hyphenator = [[PINCHTextHyphenator alloc] initWithPatternString:@"hy3ph he2n hena4 hen5at 1na n2at 1tio 2io o2n 1ce 1te 2st 1ma 1ra 1sen 1ber 1for 1ured" leftMinimum:2 rightMinimum:3];
+		NSString *string = bodyString(500);
+		
+		NSMutableIndexSet *expectedIndexes = [NSMutableIndexSet indexSet];
+		NSCharacterSet *nonLetters = [[NSCharacterSet letterCharacterSet] invertedSet];
+		NSUInteger location = 0;
+		for (NSString *token in [string componentsSeparatedByString:@" "])
+		{
+			NSString *word = [token stringByTrimmingCharactersInSet:nonLetters];
+			if ([word length] > 0)
+			{
+				NSUInteger wordLocation = location + [token rangeOfString:word].location;
+				[[hyphenator hyphenationIndexesInWord:word] enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+					[expectedIndexes addIndex:wordLocation + index];
+				}];
+			}
+			location += [token length] + 1;
+		}
+		
+		NSIndexSet *indexes = [hyphenator hyphenationIndexesInString:string];
+		expect([indexes count]).to.beGreaterThan(0);
+		expect(indexes).to.equal(expectedIndexes);
+		
+		// Hyphenating the text again finds the same points
+		expect([hyphenator hyphenationIndexesInString:string]).to.equal(indexes);
+	});
+	
 });
 
 describe(@"Parsing of strings", ^{
@@ -106,6 +1112,95 @@ describe(@"Parsing of strings", ^{
 		expect([layout.attributedString string]).to.equal(expectedParsedString);
 	});
 	
+	it(@"parses markdown links between unmatched brackets", ^{
+		NSString *markdownString = @"A ] stray ( and [no URL] here, [empty]() and [a link](http://www.justpinch.com/) [unclosed (";
+		NSString *expectedParsedString = @"A ] stray ( and [no URL] here, [empty]() and a link [unclosed (";
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:markdownString attributes:nil name:nil];
+		expect([layout.attributedString string]).to.equal(expectedParsedString);
+		
+		NSRange linkRange = NSMakeRange(NSNotFound, 0);
+		NSUInteger linkLocation = [expectedParsedString rangeOfString:@"a link"].location;
+		NSURL *URL = [layout.attributedString attribute:PINCHTextLayoutURLStringAttribute atIndex:linkLocation longestEffectiveRange:&linkRange inRange:NSMakeRange(0, expectedParsedString.length)];
+		expect(URL).to.equal([NSURL URLWithString:@"http://www.justpinch.com/"]);
+		expect(NSEqualRanges(linkRange, NSMakeRange(linkLocation, 6))).to.beTruthy();
+	});
+	
+	it(@"detects data once for identical strings", ^{
+		PINCHTextDataDetector *dataDetector = [PINCHTextDataDetector sharedDataDetector];
+		[dataDetector removeAllResults];
+		NSString *string = @"Visit http://www.justpinch.com/ for every article in the feed";
+		NSDictionary *attributes = @{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]};
+		
+		// Like a feed creating its layouts on the main thread, the strings are scanned on a bounded queue
+		NSMutableArray *layouts = [NSMutableArray array];
+		for (NSUInteger index = 0; index < 100; index++)
+		{
+			PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:string attributes:attributes name:nil];
+			layout.dataDetectorTypes = UIDataDetectorTypeLink;
+			[layouts addObject:layout];
+		}
+		PINCHTextLayout *lastLayout = [layouts lastObject];
+		expect([lastLayout.attributedString attribute:PINCHTextLayoutTextCheckingResultAttribute atIndex:6 effectiveRange:NULL]).willNot.beNil();
+		expect(dataDetector.missCount).to.beLessThanOrEqualTo(2);
+		
+		// Once scanned, a new layout gets its results right away
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:string attributes:attributes name:nil];
+		layout.dataDetectorTypes = UIDataDetectorTypeLink;
+		NSTextCheckingResult *result = [layout.attributedString attribute:PINCHTextLayoutTextCheckingResultAttribute atIndex:6 effectiveRange:NULL];
+		expect(result.URL).to.equal([NSURL URLWithString:@"http://www.justpinch.com/"]);
+		expect(dataDetector.hitCount).to.beGreaterThan(0);
+	});
+	
+	it(@"reports every parsed link on the lines it is drawn on", ^{
+		NSString *markdownString = @"Read [the first article](http://www.justpinch.com/1) and [the second one, which is long enough to wrap](http://www.justpinch.com/2) before the end";
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:markdownString attributes:@{PINCHTextLayoutFontAttribute : [UIFont systemFontOfSize:14]} name:nil];
+		PINCHTestLinkDelegate *delegate = [[PINCHTestLinkDelegate alloc] init];
+		PINCHTextRenderer *renderer = [[PINCHTextRenderer alloc] init];
+		renderer.delegate = delegate;
+		[renderer addTextLayout:layout];
+		
+		CGRect bounds = CGRectMake(0, 0, 160, 400);
+		UIGraphicsBeginImageContext(bounds.size);
+		{
+			[renderer renderTextLayoutsInContext:UIGraphicsGetCurrentContext() withRect:bounds];
+		}
+		UIGraphicsEndImageContext();
+		
+		NSString *string = [layout.attributedString string];
+		expect(delegate.links.count).to.equal(2);
+		PINCHTextLink *firstLink = delegate.links[0];
+		PINCHTextLink *secondLink = delegate.links[1];
+		expect([string substringWithRange:firstLink.range]).to.equal(@"the first article");
+		expect([string substringWithRange:secondLink.range]).to.equal(@"the second one, which is long enough to wrap");
+		expect(secondLink.URL).to.equal([NSURL URLWithString:@"http://www.justpinch.com/2"]);
+		expect(PINCHTextLinkGetRects(secondLink, NULL, NULL)).to.beGreaterThan(1);
+	});
+	
+	it(@"hyphenates words with compiled patterns", ^{
+		PINCHTextHyphenator *hyphenator = [[PINCHTextHyphenator alloc] initWithPatternString:@"% Test patterns\n\\patterns{\nhy3ph he2n hena4 hen5at 1na n2at 1tio 2io o2n\n}" leftMinimum:2 rightMinimum:3];
+		NSMutableIndexSet *expectedIndexes = [NSMutableIndexSet indexSetWithIndex:2];
+		[expectedIndexes addIndex:6];
+		expect([hyphenator hyphenationIndexesInWord:@"hyphenation"]).to.equal(expectedIndexes);
+		expect([hyphenator stringByHyphenatingString:@"Concatenation, nation and http://nation.com"]).to.equal(@"Concate\u00ADna\u00ADtion, na\u00ADtion and http://nation.com");
+		
+		// Written and memory-mapped again, the trie finds the same points
+		NSURL *fileURL = [NSURL fileURLWithPath:[NSTemporaryDirectory() stringByAppendingPathComponent:@"hyphenation-test.pattrie"]];
+		expect([hyphenator writeToFileURL:fileURL error:NULL]).to.beTruthy();
+		PINCHTextHyphenator *mappedHyphenator = [[PINCHTextHyphenator alloc] initWithContentsOfFileURL:fileURL];
+		expect(mappedHyphenator.numberOfNodes).to.equal(hyphenator.numberOfNodes);
+		expect([mappedHyphenator hyphenationIndexesInWord:@"Hyphenation"]).to.equal(expectedIndexes);
+		
+		// Links keep their range over the inserted soft hyphens
+		[PINCHTextHyphenator setHyphenator:mappedHyphenator forLanguage:@"test"];
+		PINCHTextLayout *layout = [[PINCHTextLayout alloc] initWithString:@"A [hyphenation](http://www.justpinch.com/) of a nation" attributes:@{PINCHTextLayoutHyphenatedAttribute : @YES, PINCHTextLayoutHyphenationLanguageAttribute : @"test"} name:nil];
+		[PINCHTextHyphenator setHyphenator:nil forLanguage:@"test"];
+		expect([layout.attributedString string]).to.equal(@"A hy\u00ADphen\u00ADation of a na\u00ADtion");
+		NSRange linkRange;
+		[layout.attributedString attribute:PINCHTextLayoutURLStringAttribute atIndex:2 longestEffectiveRange:&linkRange inRange:NSMakeRange(0, layout.attributedString.length)];
+		expect(linkRange.location).to.equal(2);
+		expect(linkRange.length).to.equal(13);
+	});
+	
 });
 
 SpecEnd
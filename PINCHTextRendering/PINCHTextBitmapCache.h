@@ -0,0 +1,58 @@
+//
+//  PINCHTextBitmapCache.h
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+
+/**
+ In-memory cache of rendered textLayouts, used by textRenderers with a bitmapCache so identical text
+ doesn't need to be drawn with CoreText again, for instance when cells are reused.
+ Images are keyed by the content and attributes of the textLayout, the size it is drawn in,
+ its clippingRect and the screen scale. Images are evicted by NSCache when the byteLimit is exceeded or memory
+ runs low, in no particular order, so an image that was used recently can be evicted as well.
+ */
+@interface PINCHTextBitmapCache : NSObject
+
+/// The cache used by PINCHTextView when usesBitmapCache is set, with a byteLimit of 16MB
++ (instancetype)sharedCache;
+
+/**
+ Creates an empty cache
+ @param byteLimit The number of bytes the images in the cache may occupy
+ */
+- (instancetype)initWithByteLimit:(NSUInteger)byteLimit;
+
+/// The number of bytes the images in the cache may occupy
+@property (nonatomic, assign, readonly) NSUInteger byteLimit;
+
+/// The number of times an image was found
+@property (atomic, assign, readonly) NSUInteger hitCount;
+
+/// The number of times an image was looked up but not found
+@property (atomic, assign, readonly) NSUInteger missCount;
+
+/**
+ Returns the image stored with key, and counts the lookup as a hit or a miss
+ @param key The key of the image
+ @param links Reference to the NSArray that will be set to the links encountered while rendering the image, may be NULL
+ @return A retained CGImageRef that needs to be released, or NULL when there is no image for the key
+ */
+- (CGImageRef)copyImageForKey:(uint64_t)key links:(NSArray **)links CF_RETURNS_RETAINED;
+
+/**
+ Stores an image, which may evict other images when the byteLimit is exceeded
+ @param image The image to store
+ @param links The links encountered while rendering the image, replayed when the image is drawn
+ @param key The key of the image
+ */
+- (void)setImage:(CGImageRef)image links:(NSArray *)links forKey:(uint64_t)key;
+
+/// Removes all images and resets the counters
+- (void)removeAllImages;
+
+@end
@@ -0,0 +1,117 @@
+//
+//  PINCHTextBitmapCache.m
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import "PINCHTextBitmapCache.h"
+
+/// An image in the cache with the links that were encountered while rendering it
+@interface PINCHTextBitmap : NSObject
+
+@property (nonatomic, assign, readonly) CGImageRef image;
+@property (nonatomic, copy, readonly) NSArray *links;
+
+@end
+
+@implementation PINCHTextBitmap
+
+- (instancetype)initWithImage:(CGImageRef)image links:(NSArray *)links
+{
+	self = [super init];
+	if (self)
+	{
+		_image = CGImageRetain(image);
+		_links = [links copy];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	CGImageRelease(_image);
+}
+
+@end
+
+@interface PINCHTextBitmapCache ()
+
+@property (atomic, assign, readwrite) NSUInteger hitCount;
+@property (atomic, assign, readwrite) NSUInteger missCount;
+
+@end
+
+@implementation PINCHTextBitmapCache
+{
+	NSCache *_cache;
+}
+
++ (instancetype)sharedCache
+{
+	static PINCHTextBitmapCache *sharedCache = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedCache = [[self alloc] initWithByteLimit:16 * 1024 * 1024];
+	});
+	return sharedCache;
+}
+
+- (instancetype)initWithByteLimit:(NSUInteger)byteLimit
+{
+	self = [super init];
+	if (self)
+	{
+		_byteLimit = byteLimit;
+		_cache = [[NSCache alloc] init];
+		_cache.name = @"PINCHTextBitmapCache";
+		_cache.totalCostLimit = byteLimit;
+	}
+	return self;
+}
+
+- (CGImageRef)copyImageForKey:(uint64_t)key links:(NSArray **)links
+{
+	PINCHTextBitmap *bitmap = [_cache objectForKey:@(key)];
+	@synchronized(self)
+	{
+		if (bitmap)
+		{
+			self.hitCount++;
+		}
+		else
+		{
+			self.missCount++;
+		}
+	}
+	
+	if (links != NULL)
+	{
+		*links = bitmap.links;
+	}
+	return CGImageRetain(bitmap.image);
+}
+
+- (void)setImage:(CGImageRef)image links:(NSArray *)links forKey:(uint64_t)key
+{
+	if (image == NULL)
+	{
+		return;
+	}
+	
+	PINCHTextBitmap *bitmap = [[PINCHTextBitmap alloc] initWithImage:image links:links];
+	[_cache setObject:bitmap forKey:@(key) cost:CGImageGetBytesPerRow(image) * CGImageGetHeight(image)];
+}
+
+- (void)removeAllImages
+{
+	[_cache removeAllObjects];
+	@synchronized(self)
+	{
+		self.hitCount = 0;
+		self.missCount = 0;
+	}
+}
+
+@end
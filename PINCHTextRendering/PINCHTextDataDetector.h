@@ -0,0 +1,61 @@
+//
+//  PINCHTextDataDetector.h
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Finds NSTextCheckingResults in the strings of textLayouts with dataDetectorTypes. Scans run on a queue with a limited
+ number of concurrent operations, so creating many textLayouts at once doesn't start a thread for each of them,
+ and results are cached by string and checking types so the same string is only scanned once.
+ */
+@interface PINCHTextDataDetector : NSObject
+
+/// The detector used by all textLayouts, scanning at most two strings at a time
++ (instancetype)sharedDataDetector;
+
+/**
+ Creates a detector with an empty cache
+ @param maximumConcurrentDetections The number of strings that may be scanned at the same time
+ */
+- (instancetype)initWithMaximumConcurrentDetections:(NSUInteger)maximumConcurrentDetections;
+
+/// The number of times results were found in the cache
+@property (atomic, assign, readonly) NSUInteger hitCount;
+
+/// The number of times a string had to be scanned
+@property (atomic, assign, readonly) NSUInteger missCount;
+
+/**
+ Returns the cached results of string, without scanning it
+ @param string The string that was scanned
+ @param checkingTypes The types the string was scanned for
+ @return NSArray of NSTextCheckingResult objects, or nil when the string hasn't been scanned for checkingTypes
+ */
+- (NSArray *)cachedResultsInString:(NSString *)string checkingTypes:(NSTextCheckingTypes)checkingTypes;
+
+/**
+ Returns the results of string, scanning it on the current thread when they aren't cached
+ @param string The string to scan
+ @param checkingTypes The types to scan for
+ @return NSArray of NSTextCheckingResult objects
+ */
+- (NSArray *)resultsInString:(NSString *)string checkingTypes:(NSTextCheckingTypes)checkingTypes;
+
+/**
+ Scans string on the queue of the detector
+ @param string The string to scan
+ @param checkingTypes The types to scan for
+ @param completion Called on the main queue with the NSTextCheckingResult objects, not called when cancelled
+ @return The operation of the scan, cancel it when the results are no longer needed
+ */
+- (NSOperation *)detectResultsInString:(NSString *)string checkingTypes:(NSTextCheckingTypes)checkingTypes completion:(void (^)(NSArray *results))completion;
+
+/// Removes all cached results and resets the counters
+- (void)removeAllResults;
+
+@end
@@ -0,0 +1,176 @@
+//
+//  PINCHTextDataDetector.m
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import "PINCHTextDataDetector.h"
+#import "PINCHTextMeasurementCache.h"
+
+static NSUInteger maximumNumberOfCachedStrings = 256;
+
+/// Hashes the characters of string and the checkingTypes, used as key in the cache
+static uint64_t PINCHTextDataDetectorKey(NSString *string, NSTextCheckingTypes checkingTypes)
+{
+	uint64_t key = PINCHTextMeasurementHash(PINCHTextMeasurementHashInitial, &checkingTypes, sizeof(checkingTypes));
+	
+	CFStringRef cfString = (__bridge CFStringRef)string;
+	CFIndex length = CFStringGetLength(cfString);
+	const UniChar *characters = CFStringGetCharactersPtr(cfString);
+	if (characters != NULL)
+	{
+		return PINCHTextMeasurementHash(key, characters, (size_t)length * sizeof(UniChar));
+	}
+	
+	UniChar buffer[256];
+	for (CFIndex location = 0; location < length; location += 256)
+	{
+		CFRange range = CFRangeMake(location, MIN(256, length - location));
+		CFStringGetCharacters(cfString, range, buffer);
+		key = PINCHTextMeasurementHash(key, buffer, (size_t)range.length * sizeof(UniChar));
+	}
+	return key;
+}
+
+@interface PINCHTextDataDetector ()
+
+@property (atomic, assign, readwrite) NSUInteger hitCount;
+@property (atomic, assign, readwrite) NSUInteger missCount;
+@property (nonatomic, strong) NSOperationQueue *queue;
+
+/// Dictionaries with the scanned String and its Results, keyed by PINCHTextDataDetectorKey()
+@property (nonatomic, strong) NSCache *cache;
+
+/// NSDataDetector instances keyed by their checkingTypes, they can be used on multiple threads
+@property (nonatomic, strong) NSMutableDictionary *dataDetectors;
+
+@end
+
+@implementation PINCHTextDataDetector
+
++ (instancetype)sharedDataDetector
+{
+	static PINCHTextDataDetector *sharedDataDetector = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedDataDetector = [[self alloc] initWithMaximumConcurrentDetections:2];
+	});
+	return sharedDataDetector;
+}
+
+- (instancetype)init
+{
+	return [self initWithMaximumConcurrentDetections:2];
+}
+
+- (instancetype)initWithMaximumConcurrentDetections:(NSUInteger)maximumConcurrentDetections
+{
+	self = [super init];
+	if (self)
+	{
+		_queue = [[NSOperationQueue alloc] init];
+		_queue.name = @"PINCHTextDataDetector";
+		_queue.maxConcurrentOperationCount = MAX(maximumConcurrentDetections, (NSUInteger)1);
+		_cache = [[NSCache alloc] init];
+		_cache.countLimit = maximumNumberOfCachedStrings;
+		_dataDetectors = [NSMutableDictionary dictionary];
+	}
+	return self;
+}
+
+#pragma mark - Results
+
+- (NSArray *)cachedResultsInString:(NSString *)string checkingTypes:(NSTextCheckingTypes)checkingTypes
+{
+	if (!string)
+	{
+		return nil;
+	}
+	
+	// Different strings can share a key, so the string is compared as well
+	NSDictionary *cachedResults = [self.cache objectForKey:@(PINCHTextDataDetectorKey(string, checkingTypes))];
+	if (cachedResults && [cachedResults[@"String"] isEqualToString:string])
+	{
+		@synchronized(self)
+		{
+			self.hitCount++;
+		}
+		return cachedResults[@"Results"];
+	}
+	return nil;
+}
+
+- (NSArray *)resultsInString:(NSString *)string checkingTypes:(NSTextCheckingTypes)checkingTypes
+{
+	NSArray *results = [self cachedResultsInString:string checkingTypes:checkingTypes];
+	if (results)
+	{
+		return results;
+	}
+	
+	string = [string copy];
+	@synchronized(self)
+	{
+		self.missCount++;
+	}
+	results = [[self dataDetectorWithCheckingTypes:checkingTypes] matchesInString:string options:0 range:NSMakeRange(0, [string length])] ?: @[];
+	[self.cache setObject:@{@"String": string, @"Results": results} forKey:@(PINCHTextDataDetectorKey(string, checkingTypes))];
+	return results;
+}
+
+- (NSOperation *)detectResultsInString:(NSString *)string checkingTypes:(NSTextCheckingTypes)checkingTypes completion:(void (^)(NSArray *))completion
+{
+	string = [string copy];
+	
+	NSBlockOperation *operation = [[NSBlockOperation alloc] init];
+	__weak NSBlockOperation *weakOperation = operation;
+	[operation addExecutionBlock:^{
+		// Operations of deallocated textLayouts are cancelled before they get the chance to scan
+		if (weakOperation.isCancelled)
+		{
+			return;
+		}
+		
+		NSArray *results = [self resultsInString:string checkingTypes:checkingTypes];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (!weakOperation.isCancelled && completion)
+			{
+				completion(results);
+			}
+		});
+	}];
+	
+	[self.queue addOperation:operation];
+	return operation;
+}
+
+- (NSDataDetector *)dataDetectorWithCheckingTypes:(NSTextCheckingTypes)checkingTypes
+{
+	@synchronized(self.dataDetectors)
+	{
+		NSDataDetector *dataDetector = self.dataDetectors[@(checkingTypes)];
+		if (!dataDetector)
+		{
+			dataDetector = [NSDataDetector dataDetectorWithTypes:checkingTypes error:nil];
+			if (dataDetector)
+			{
+				self.dataDetectors[@(checkingTypes)] = dataDetector;
+			}
+		}
+		return dataDetector;
+	}
+}
+
+- (void)removeAllResults
+{
+	[self.cache removeAllObjects];
+	@synchronized(self)
+	{
+		self.hitCount = 0;
+		self.missCount = 0;
+	}
+}
+
+@end
@@ -0,0 +1,82 @@
+//
+//  PINCHTextHyphenator.h
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Finds hyphenation points in words with Liang's algorithm, as used by TeX. The patterns of a language are compiled
+ into a compact trie that can be written to a file and memory-mapped again, so loading a language doesn't parse
+ or copy its patterns. Results are cached per word.
+ 
+ TextLayouts that are hyphenated insert soft hyphens at the hyphenation points of their string when
+ a hyphenator is registered for their PINCHTextLayoutHyphenationLanguageAttribute.
+ */
+@interface PINCHTextHyphenator : NSObject
+
+/**
+ Returns the hyphenator registered for language. When none has been registered, the compiled patterns are
+ loaded from a file named hyphenation-<language>.pattrie in the main bundle, if there is one
+ @param language The language code, like en-US or nl
+ */
++ (instancetype)hyphenatorForLanguage:(NSString *)language;
+
+/**
+ Registers the hyphenator used for language, replacing any previously registered hyphenator
+ @param hyphenator The hyphenator, or nil to remove the registered hyphenator
+ @param language The language code, like en-US or nl
+ */
++ (void)setHyphenator:(PINCHTextHyphenator *)hyphenator forLanguage:(NSString *)language;
+
+/**
+ Compiles patterns in the format of TeX hyphenation files, like "hy3ph" or ".ach4"
+ @param patterns String with the patterns separated by whitespace, lines starting with % are ignored
+ as well as \patterns{ and the closing brace
+ @param leftMinimum The minimum number of characters before a hyphen
+ @param rightMinimum The minimum number of characters after a hyphen
+ */
+- (instancetype)initWithPatternString:(NSString *)patterns leftMinimum:(NSUInteger)leftMinimum rightMinimum:(NSUInteger)rightMinimum;
+
+/**
+ Memory-maps patterns that have been compiled and written with writeToFileURL:error:
+ @param fileURL The URL of the file with the compiled patterns
+ @return The hyphenator, or nil when the file can't be read or isn't a compiled pattern file
+ */
+- (instancetype)initWithContentsOfFileURL:(NSURL *)fileURL;
+
+/**
+ Writes the compiled patterns to a file, to be loaded with initWithContentsOfFileURL:
+ @param fileURL The URL of the file to write to
+ @param error Reference to the error that is set when writing fails, may be NULL
+ @return Whether the file has been written
+ */
+- (BOOL)writeToFileURL:(NSURL *)fileURL error:(NSError **)error;
+
+/// The number of nodes in the compiled trie
+@property (nonatomic, assign, readonly) NSUInteger numberOfNodes;
+
+/**
+ Returns the indexes in word a hyphen can be inserted before
+ @param word A single word of letters
+ @return Indexes between leftMinimum and the length of word minus rightMinimum
+ */
+- (NSIndexSet *)hyphenationIndexesInWord:(NSString *)word;
+
+/**
+ Returns the indexes in string a hyphen can be inserted before. Only words of letters are hyphenated,
+ text like URLs, e-mail addresses and words that already contain soft hyphens is skipped
+ @param string The string to hyphenate
+ */
+- (NSIndexSet *)hyphenationIndexesInString:(NSString *)string;
+
+/**
+ Returns string with soft hyphens inserted at all hyphenation indexes
+ @param string The string to hyphenate
+ */
+- (NSString *)stringByHyphenatingString:(NSString *)string;
+
+@end
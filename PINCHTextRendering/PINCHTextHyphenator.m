@@ -0,0 +1,459 @@
+//
+//  PINCHTextHyphenator.m
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import "PINCHTextHyphenator.h"
+
+static uint32_t hyphenationFileMagic = 0x50544859; // PTHY
+static uint32_t hyphenationFileVersion = 1;
+static NSUInteger maximumNumberOfCachedWords = 4096;
+static const unichar softHyphen = 0x00AD;
+
+/// Start of a compiled pattern file, followed by the nodes, the edges and the values
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numberOfNodes;
+	uint32_t numberOfEdges;
+	uint32_t numberOfValues;
+	uint16_t leftMinimum;
+	uint16_t rightMinimum;
+} PINCHTextHyphenationHeader;
+
+/// A node of the trie, the first node is the root
+typedef struct {
+	/// Index of the first edge to a child, the edges of a node are sorted by character
+	uint32_t firstEdge;
+	/// Index of the first value of the pattern ending at this node
+	uint32_t firstValue;
+	uint16_t numberOfEdges;
+	/// The number of values of the pattern ending at this node, zero when no pattern ends here
+	uint16_t numberOfValues;
+} PINCHTextHyphenationNode;
+
+typedef struct {
+	uint16_t character;
+	uint16_t reserved;
+	uint32_t node;
+} PINCHTextHyphenationEdge;
+
+/// Returns the child of node for character, or UINT32_MAX when there is none
+static inline uint32_t PINCHTextHyphenationChild(const PINCHTextHyphenationNode *node, const PINCHTextHyphenationEdge *edges, uint32_t numberOfEdges, unichar character)
+{
+	uint32_t lower = node->firstEdge;
+	uint32_t upper = node->firstEdge + node->numberOfEdges;
+	if (upper > numberOfEdges)
+	{
+		return UINT32_MAX;
+	}
+	while (lower < upper)
+	{
+		uint32_t middle = lower + (upper - lower) / 2;
+		if (edges[middle].character < character)
+		{
+			lower = middle + 1;
+		}
+		else
+		{
+			upper = middle;
+		}
+	}
+	return (lower < node->firstEdge + node->numberOfEdges && edges[lower].character == character ? edges[lower].node : UINT32_MAX);
+}
+
+@interface PINCHTextHyphenator ()
+
+/// The header, nodes, edges and values, compiled or memory-mapped from a file
+@property (nonatomic, strong) NSData *trieData;
+
+/// NSIndexSet of the hyphenation indexes, keyed by word
+@property (nonatomic, strong) NSCache *wordCache;
+
+@end
+
+@implementation PINCHTextHyphenator
+{
+	// Pointers into trieData
+	const PINCHTextHyphenationHeader *_header;
+	const PINCHTextHyphenationNode *_nodes;
+	const PINCHTextHyphenationEdge *_edges;
+	const uint8_t *_values;
+}
+
+#pragma mark - Registered hyphenators
+
++ (NSMutableDictionary *)registeredHyphenators
+{
+	static NSMutableDictionary *registeredHyphenators = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		registeredHyphenators = [NSMutableDictionary dictionary];
+	});
+	return registeredHyphenators;
+}
+
++ (instancetype)hyphenatorForLanguage:(NSString *)language
+{
+	if ([language length] == 0)
+	{
+		return nil;
+	}
+	
+	NSMutableDictionary *registeredHyphenators = [self registeredHyphenators];
+	@synchronized(registeredHyphenators)
+	{
+		id hyphenator = registeredHyphenators[language];
+		if (!hyphenator)
+		{
+			NSURL *fileURL = [[NSBundle mainBundle] URLForResource:[@"hyphenation-" stringByAppendingString:language] withExtension:@"pattrie"];
+			hyphenator = (fileURL ? [[self alloc] initWithContentsOfFileURL:fileURL] : nil) ?: [NSNull null];
+			// Also remembered when there is no file, so it is only looked for once
+			registeredHyphenators[language] = hyphenator;
+		}
+		return (hyphenator == [NSNull null] ? nil : hyphenator);
+	}
+}
+
++ (void)setHyphenator:(PINCHTextHyphenator *)hyphenator forLanguage:(NSString *)language
+{
+	NSMutableDictionary *registeredHyphenators = [self registeredHyphenators];
+	@synchronized(registeredHyphenators)
+	{
+		if (hyphenator)
+		{
+			registeredHyphenators[language] = hyphenator;
+		}
+		else
+		{
+			[registeredHyphenators removeObjectForKey:language];
+		}
+	}
+}
+
+#pragma mark - Initializers
+
+- (instancetype)initWithTrieData:(NSData *)trieData
+{
+	if ([trieData length] < sizeof(PINCHTextHyphenationHeader))
+	{
+		return nil;
+	}
+	
+	const PINCHTextHyphenationHeader *header = [trieData bytes];
+	NSUInteger expectedLength = sizeof(PINCHTextHyphenationHeader) +
+								(NSUInteger)header->numberOfNodes * sizeof(PINCHTextHyphenationNode) +
+								(NSUInteger)header->numberOfEdges * sizeof(PINCHTextHyphenationEdge) +
+								(NSUInteger)header->numberOfValues;
+	if (header->magic != hyphenationFileMagic || header->version != hyphenationFileVersion ||
+		header->numberOfNodes == 0 || [trieData length] != expectedLength)
+	{
+		return nil;
+	}
+	
+	self = [super init];
+	if (self)
+	{
+		_trieData = trieData;
+		_header = header;
+		_nodes = (const PINCHTextHyphenationNode *)(header + 1);
+		_edges = (const PINCHTextHyphenationEdge *)(_nodes + header->numberOfNodes);
+		_values = (const uint8_t *)(_edges + header->numberOfEdges);
+		_wordCache = [[NSCache alloc] init];
+		_wordCache.countLimit = maximumNumberOfCachedWords;
+	}
+	return self;
+}
+
+- (instancetype)initWithContentsOfFileURL:(NSURL *)fileURL
+{
+	// Mapped, so only the pages of the trie that are used get read
+	NSData *trieData = [NSData dataWithContentsOfURL:fileURL options:NSDataReadingMappedAlways error:NULL];
+	return [self initWithTrieData:trieData];
+}
+
+- (instancetype)initWithPatternString:(NSString *)patterns leftMinimum:(NSUInteger)leftMinimum rightMinimum:(NSUInteger)rightMinimum
+{
+	// Built with a dictionary of children per node, then flattened into sorted edges
+	NSMutableArray *children = [NSMutableArray arrayWithObject:[NSMutableDictionary dictionary]];
+	NSMutableArray *nodeValues = [NSMutableArray arrayWithObject:[NSNull null]];
+	
+	NSCharacterSet *whitespace = [NSCharacterSet whitespaceCharacterSet];
+	NSCharacterSet *decimalDigits = [NSCharacterSet decimalDigitCharacterSet];
+	for (NSString *line in [patterns componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]])
+	{
+		NSString *content = [[line componentsSeparatedByString:@"%"] firstObject];
+		for (NSString *component in [content componentsSeparatedByCharactersInSet:whitespace])
+		{
+			NSString *pattern = [[component stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"{}"]] lowercaseString];
+			if ([pattern length] == 0 || [pattern hasPrefix:@"\\"])
+			{
+				continue;
+			}
+			
+			// Digits are the values of the positions before the letters, the last one after all letters
+			NSUInteger node = 0;
+			NSMutableData *values = [NSMutableData dataWithLength:1];
+			for (NSUInteger index = 0; index < [pattern length]; index++)
+			{
+				unichar character = [pattern characterAtIndex:index];
+				if ([decimalDigits characterIsMember:character])
+				{
+					((uint8_t *)[values mutableBytes])[[values length] - 1] = (uint8_t)(character - '0');
+					continue;
+				}
+				
+				NSMutableDictionary *nodeChildren = children[node];
+				NSNumber *child = nodeChildren[@(character)];
+				if (!child)
+				{
+					child = @([children count]);
+					nodeChildren[@(character)] = child;
+					[children addObject:[NSMutableDictionary dictionary]];
+					[nodeValues addObject:[NSNull null]];
+				}
+				node = [child unsignedIntegerValue];
+				[values increaseLengthBy:1];
+			}
+			
+			// Trailing zeros don't raise any position, so they aren't stored
+			NSUInteger length = [values length];
+			while (length > 0 && ((const uint8_t *)[values bytes])[length - 1] == 0)
+			{
+				length--;
+			}
+			[values setLength:length];
+			nodeValues[node] = values;
+		}
+	}
+	
+	PINCHTextHyphenationHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = hyphenationFileMagic;
+	header.version = hyphenationFileVersion;
+	header.numberOfNodes = (uint32_t)[children count];
+	header.leftMinimum = (uint16_t)leftMinimum;
+	header.rightMinimum = (uint16_t)rightMinimum;
+	
+	NSMutableData *nodeData = [NSMutableData data];
+	NSMutableData *edgeData = [NSMutableData data];
+	NSMutableData *valueData = [NSMutableData data];
+	for (NSUInteger nodeIndex = 0; nodeIndex < [children count]; nodeIndex++)
+	{
+		NSDictionary *nodeChildren = children[nodeIndex];
+		NSArray *characters = [[nodeChildren allKeys] sortedArrayUsingSelector:@selector(compare:)];
+		
+		PINCHTextHyphenationNode node;
+		memset(&node, 0, sizeof(node));
+		node.firstEdge = (uint32_t)([edgeData length] / sizeof(PINCHTextHyphenationEdge));
+		node.numberOfEdges = (uint16_t)[characters count];
+		node.firstValue = (uint32_t)[valueData length];
+		
+		NSData *values = nodeValues[nodeIndex];
+		if ([values isKindOfClass:[NSData class]])
+		{
+			node.numberOfValues = (uint16_t)[values length];
+			[valueData appendData:values];
+		}
+		[nodeData appendBytes:&node length:sizeof(node)];
+		
+		for (NSNumber *character in characters)
+		{
+			PINCHTextHyphenationEdge edge;
+			memset(&edge, 0, sizeof(edge));
+			edge.character = [character unsignedShortValue];
+			edge.node = [nodeChildren[character] unsignedIntValue];
+			[edgeData appendBytes:&edge length:sizeof(edge)];
+		}
+	}
+	header.numberOfEdges = (uint32_t)([edgeData length] / sizeof(PINCHTextHyphenationEdge));
+	header.numberOfValues = (uint32_t)[valueData length];
+	
+	NSMutableData *trieData = [NSMutableData dataWithBytes:&header length:sizeof(header)];
+	[trieData appendData:nodeData];
+	[trieData appendData:edgeData];
+	[trieData appendData:valueData];
+	return [self initWithTrieData:trieData];
+}
+
+- (BOOL)writeToFileURL:(NSURL *)fileURL error:(NSError **)error
+{
+	return [self.trieData writeToURL:fileURL options:NSDataWritingAtomic error:error];
+}
+
+- (NSUInteger)numberOfNodes
+{
+	return _header->numberOfNodes;
+}
+
+#pragma mark - Hyphenation
+
+- (NSIndexSet *)hyphenationIndexesInWord:(NSString *)word
+{
+	NSIndexSet *cachedIndexes = [self.wordCache objectForKey:word];
+	if (cachedIndexes)
+	{
+		return cachedIndexes;
+	}
+	
+	NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+	NSString *lowercaseWord = [word lowercaseString];
+	NSUInteger length = [word length];
+	NSUInteger leftMinimum = MAX(_header->leftMinimum, (uint16_t)1);
+	NSUInteger rightMinimum = MAX(_header->rightMinimum, (uint16_t)1);
+	
+	// Lowercasing can change the length of a word, its positions wouldn't match the word anymore
+	if (length >= leftMinimum + rightMinimum && [lowercaseWord length] == length)
+	{
+		// The word between dots, with a value for every position between two characters
+		NSUInteger dottedLength = length + 2;
+		unichar *characters = malloc(sizeof(unichar) * dottedLength);
+		uint8_t *points = calloc(dottedLength + 1, sizeof(uint8_t));
+		characters[0] = '.';
+		[lowercaseWord getCharacters:characters + 1 range:NSMakeRange(0, length)];
+		characters[dottedLength - 1] = '.';
+		
+		uint32_t numberOfNodes = _header->numberOfNodes;
+		uint32_t numberOfEdges = _header->numberOfEdges;
+		uint32_t numberOfValues = _header->numberOfValues;
+		for (NSUInteger start = 0; start < dottedLength; start++)
+		{
+			uint32_t nodeIndex = 0;
+			for (NSUInteger end = start; end < dottedLength; end++)
+			{
+				nodeIndex = PINCHTextHyphenationChild(&_nodes[nodeIndex], _edges, numberOfEdges, characters[end]);
+				if (nodeIndex >= numberOfNodes)
+				{
+					break;
+				}
+				
+				// Every pattern that matches raises the values of the positions it covers
+				const PINCHTextHyphenationNode *node = &_nodes[nodeIndex];
+				if (node->numberOfValues > 0 && node->firstValue + node->numberOfValues <= numberOfValues)
+				{
+					NSUInteger numberOfPositions = MIN((NSUInteger)node->numberOfValues, dottedLength + 1 - start);
+					for (NSUInteger position = 0; position < numberOfPositions; position++)
+					{
+						points[start + position] = MAX(points[start + position], _values[node->firstValue + position]);
+					}
+				}
+			}
+		}
+		
+		// Odd values allow a hyphen, the position before character index of the word is index + 1 in the dotted word
+		for (NSUInteger index = leftMinimum; index + rightMinimum <= length; index++)
+		{
+			if (points[index + 1] % 2 == 1)
+			{
+				[indexes addIndex:index];
+			}
+		}
+		
+		free(characters);
+		free(points);
+	}
+	
+	NSIndexSet *hyphenationIndexes = [indexes copy];
+	[self.wordCache setObject:hyphenationIndexes forKey:[word copy]];
+	return hyphenationIndexes;
+}
+
+- (NSIndexSet *)hyphenationIndexesInString:(NSString *)string
+{
+	static NSCharacterSet *letters = nil;
+	static NSCharacterSet *whitespace = nil;
+	static NSCharacterSet *wordConnectors = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		letters = [NSCharacterSet letterCharacterSet];
+		whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+		wordConnectors = [NSCharacterSet characterSetWithCharactersInString:@"-'’"];
+	});
+	
+	NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
+	NSUInteger length = [string length];
+	unichar *characters = malloc(sizeof(unichar) * MAX(length, (NSUInteger)1));
+	[string getCharacters:characters range:NSMakeRange(0, length)];
+	
+	NSUInteger location = 0;
+	while (location < length)
+	{
+		// Whitespace separated tokens, without the punctuation around them
+		while (location < length && [whitespace characterIsMember:characters[location]])
+		{
+			location++;
+		}
+		NSUInteger tokenEnd = location;
+		while (tokenEnd < length && ![whitespace characterIsMember:characters[tokenEnd]])
+		{
+			tokenEnd++;
+		}
+		NSUInteger start = location;
+		NSUInteger end = tokenEnd;
+		location = tokenEnd;
+		while (start < end && ![letters characterIsMember:characters[start]])
+		{
+			start++;
+		}
+		while (end > start && ![letters characterIsMember:characters[end - 1]])
+		{
+			end--;
+		}
+		
+		// Tokens with anything but letters and hyphens are likely URLs, addresses or already hyphenated
+		BOOL onlyLetters = YES;
+		for (NSUInteger index = start; index < end && onlyLetters; index++)
+		{
+			onlyLetters = ([letters characterIsMember:characters[index]] || [wordConnectors characterIsMember:characters[index]]);
+		}
+		if (!onlyLetters)
+		{
+			continue;
+		}
+		
+		// Compound words are hyphenated per part
+		NSUInteger wordStart = start;
+		for (NSUInteger index = start; index <= end; index++)
+		{
+			if (index < end && [letters characterIsMember:characters[index]])
+			{
+				continue;
+			}
+			if (index > wordStart)
+			{
+				NSString *word = [[NSString alloc] initWithCharacters:characters + wordStart length:index - wordStart];
+				[[self hyphenationIndexesInWord:word] enumerateIndexesUsingBlock:^(NSUInteger wordIndex, BOOL *stop) {
+					[indexes addIndex:wordStart + wordIndex];
+				}];
+			}
+			wordStart = index + 1;
+		}
+	}
+	
+	free(characters);
+	return [indexes copy];
+}
+
+- (NSString *)stringByHyphenatingString:(NSString *)string
+{
+	NSIndexSet *indexes = [self hyphenationIndexesInString:string];
+	if ([indexes count] == 0)
+	{
+		return string;
+	}
+	
+	NSMutableString *hyphenatedString = [NSMutableString stringWithCapacity:[string length] + [indexes count]];
+	__block NSUInteger copiedLocation = 0;
+	[indexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+		[hyphenatedString appendString:[string substringWithRange:NSMakeRange(copiedLocation, index - copiedLocation)]];
+		[hyphenatedString appendFormat:@"%C", softHyphen];
+		copiedLocation = index;
+	}];
+	[hyphenatedString appendString:[string substringFromIndex:copiedLocation]];
+	return hyphenatedString;
+}
+
+@end
@@ -14,6 +14,11 @@
  */
 extern UIEdgeInsets PINCHEdgeInsetsInvert(UIEdgeInsets edgeInsets);
 
+/**
+ Returns the number of device pixels per point of the context, like the scale of a screen
+ */
+extern CGFloat PINCHContextGetScale(CGContextRef context);
+
 /**
  Returns a created CFDictionaryRef with clipping the given clipping rect and transform applied to it
  */
@@ -40,10 +45,14 @@ extern NSString *const PINCHTextLayoutTextInsetsAttribute;
 extern NSString *const PINCHTextLayoutClippingRectInsetsAttribute;
 /// Expects an NSNumber float (CGFloat) value.
 extern NSString *const PINCHTextLayoutMinimumScaleFactorAttribute;
+/// Expects an NSNumber float (CGFloat) value.
+extern NSString *const PINCHTextLayoutScaleFactorPrecisionAttribute;
 /// Expects an NSNumber BOOL value
 extern NSString *const PINCHTextLayoutBreaksLastLineAttribute;
 /// Expects an NSNumber BOOL value
 extern NSString *const PINCHTextLayoutHyphenatedAttribute;
+/// Expects an NSString language code, used to find the PINCHTextHyphenator of a hyphenated layout
+extern NSString *const PINCHTextLayoutHyphenationLanguageAttribute;
 /// Expects an NSNumber float (CGFloat) value.
 extern NSString *const PINCHTextLayoutLastLineInsetAttribute;
 /// Expects an NSNumber BOOL value
@@ -62,6 +71,7 @@ extern NSString *const PINCHTextLayoutURLStringAttribute;
 extern NSString *const PINCHTextLayoutTextCheckingResultAttribute;
 
 @class PINCHTextRenderer;
+@class PINCHTextLayoutResult;
 
 /**
  Data object responsible for holding an attributed string, calculating its height and rendering it in a given context.
@@ -79,6 +89,12 @@ extern NSString *const PINCHTextLayoutTextCheckingResultAttribute;
 	CGFloat _initialFontSize;
 	/// The lineHeight when scaleFactor = 1
 	CGFloat _initialLineHeight;
+	/**
+	 The scale factor the next iteration of the bounds calculation will be done with.
+	 Trial scale factors are calculated on a scaled copy of the attributed string,
+	 only the scale factor that is eventually picked is applied to attributedString.
+	 */
+	CGFloat _trialScaleFactor;
 }
 
 /**
@@ -154,6 +170,9 @@ extern NSString *const PINCHTextLayoutTextCheckingResultAttribute;
 /// The scaleFactor with which the fontSize can be scaled down to fit the size and/or numberOfLines.
 @property (nonatomic, assign) CGFloat minimumScaleFactor;
 
+/// The precision with which the largest fitting scaleFactor is searched for. Default is 0.05
+@property (nonatomic, assign) CGFloat scaleFactorPrecision;
+
 /// The actual scaleFactor applied to make the string fit. Cleared when invalidateLayoutCache is called.
 @property (nonatomic, assign, readonly) CGFloat actualScaleFactor;
 
@@ -163,6 +182,10 @@ extern NSString *const PINCHTextLayoutTextCheckingResultAttribute;
 /// Whether the string is hyphenated, meaning soft hyphens ((unichar)0xad) are a added betwean all syllables
 @property (nonatomic, assign, getter = isHyphenated) BOOL hyphenated;
 
+/// The language the string is hyphenated in when the layout is created. When a PINCHTextHyphenator is registered
+/// for it and the layout is hyphenated, soft hyphens are inserted at its hyphenation points
+@property (nonatomic, copy, readonly) NSString *hyphenationLanguage;
+
 /// Inset for the last line, makes the last line shorter
 @property (nonatomic, assign) CGFloat lastLineInset;
 
@@ -188,6 +211,9 @@ extern NSString *const PINCHTextLayoutTextCheckingResultAttribute;
 /// Initially set to YES, invalidating does the same. Only NO after calculating and string doens't fit
 @property (nonatomic, assign, readonly) BOOL stringFitsProposedRect;
 
+/// The result of the last size calculation. Cleared when invalidateLayoutCache is called.
+@property (atomic, strong, readonly) PINCHTextLayoutResult *layoutResult;
+
 /**
  @name String attribute modifiers
  */
@@ -214,9 +240,19 @@ extern NSString *const PINCHTextLayoutTextCheckingResultAttribute;
  @param clippingRect Reference to the CGRect that may clip the string. This rect may be made bigger to accommodate the clippingRectInsets values
  @param containerRect The containerRect (usually CGContextGetClipBoundingBox()) in which transform needs to be made
  @return The bounding rect in which the textLayout can be rendered
+ @note The results of the last few proposed rects and clippingRects are cached until invalidateLayoutCache is called
  */
 - (CGRect)boundingRectForProposedRect:(CGRect)proposedRect withClippingRect:(CGRect *)clippingRect containerRect:(CGRect)containerRect;
 
+/**
+ Calculates the layout of the attributedString within the given rect, like boundingRectForProposedRect:withClippingRect:containerRect:
+ @param rect The rect in which the textLayout's bounding rect should be calculated
+ @param clippingRect Reference to the CGRect that may clip the string. This rect may be made bigger to accommodate the clippingRectInsets values
+ @param containerRect The containerRect (usually CGContextGetClipBoundingBox()) in which transform needs to be made
+ @return An immutable result that can be drawn with drawLayoutResult:inContext:, also set as layoutResult
+ */
+- (PINCHTextLayoutResult *)layoutResultForProposedRect:(CGRect)proposedRect withClippingRect:(CGRect *)clippingRect containerRect:(CGRect)containerRect;
+
 /**
  @name Drawing methods
  */
@@ -235,6 +271,14 @@ extern NSString *const PINCHTextLayoutTextCheckingResultAttribute;
  */
 - (void)drawInContext:(CGContextRef)context withRect:(CGRect)rect clippingRect:(CGRect)clippingRect;
 
+/**
+ Draws the lines of a calculated layout into the provided context at its boundingRect, without typesetting the string again.
+ Doesn't lock the textLayout, so results can be drawn on any thread
+ @param layoutResult The result of layoutResultForProposedRect:withClippingRect:containerRect:
+ @param context The CGContextRef to draw the layout in
+ */
+- (void)drawLayoutResult:(PINCHTextLayoutResult *)layoutResult inContext:(CGContextRef)context;
+
 @end
 
 @interface PINCHTextLayout (PINCHTextSubclassingHooks)
@@ -249,13 +293,16 @@ extern NSString *const PINCHTextLayoutTextCheckingResultAttribute;
 
 /**
  Subclass this method to set the size of the steps in iterating the scale factor.
- @return The size of the set (default is 0.05)
+ Only scale factors that are a multiple of this step below 1.0 are tried.
+ @return The size of the set (default is scaleFactorPrecision, or 0.05 when not set)
  */
 - (CGFloat)scaleFactorStepSize;
 
 /**
- Called from boundingRectForProposedRect:withClippingRect:containerRect: at the end of an iteration.
- Handles the change in scale factor and whether the iteration should stop.
+ Called from boundingRectForProposedRect:withClippingRect:containerRect: at the end of an iteration
+ with the size calculated at _trialScaleFactor. The default implementation bisects the range between
+ minimumScaleFactor and 1.0, starting at the scale factor fitted for the previous proposed rect.
+ Sets _trialScaleFactor for the next iteration, or actualScaleFactor when the iteration should stop.
  @param size The size the currenlty calculated string
  @param cappedString Whether the string fits in the proposed rect
  @param shouldStopIterationg When set to YES, the returned size will be used to return in boundingRectForProposedRect:
@@ -7,30 +7,322 @@
 //
 
 #import <CoreText/CoreText.h>
+#import "PINCHTextDataDetector.h"
+#import "PINCHTextHyphenator.h"
 #import "PINCHTextLayout.h"
+#import "PINCHTextLayoutResult.h"
+#import "PINCHTextMeasurementCache.h"
+#import "PINCHTextPrefetcher.h"
 #import "PINCHTextRenderer.h"
 #import "PINCHTextRendering.h"
 
-static dispatch_queue_t _pinch_framesetterQueue;
+static NSUInteger maximumNumberOfCachedFramesetters = 4;
+static NSUInteger maximumNumberOfCachedLayouts = 8;
 
-static inline dispatch_queue_t pinch_framesetterQueue();
-static int queueKey;
-
-static inline dispatch_queue_t pinch_framesetterQueue() {
-	if (_pinch_framesetterQueue == NULL)
+/// Returns the clippingRect with an origin relative to the origin of rect, or CGRectZero when empty
+static inline CGRect PINCHClippingRectRelativeToRect(CGRect clippingRect, CGRect rect)
+{
+	if (CGRectIsEmpty(clippingRect))
 	{
-		_pinch_framesetterQueue = dispatch_queue_create("com.pinch.framesetterqueue", DISPATCH_QUEUE_SERIAL);
-		CFStringRef tag = CFSTR("framesetter");
-		dispatch_queue_set_specific(_pinch_framesetterQueue, &queueKey, (void *)tag, NULL);
+		return CGRectZero;
 	}
-	return _pinch_framesetterQueue;
-};
+	return CGRectOffset(clippingRect, -CGRectGetMinX(rect), -CGRectGetMinY(rect));
+}
 
 inline UIEdgeInsets PINCHEdgeInsetsInvert(UIEdgeInsets edgeInsets)
 {
 	return UIEdgeInsetsMake(-edgeInsets.top, -edgeInsets.left, -edgeInsets.bottom, -edgeInsets.right);
 }
 
+CGFloat PINCHContextGetScale(CGContextRef context)
+{
+	// Read from the context itself, so drawing doesn't depend on UIScreen and works on any thread
+	CGAffineTransform transform = CGContextGetUserSpaceToDeviceSpaceTransform(context);
+	CGFloat scale = (CGFloat)hypot(transform.a, transform.b);
+	return (scale > 0 ? scale : 1);
+}
+
+/// The geometry a hyphenated line has been created for, compared bytewise
+typedef struct {
+	NSRange range;
+	CGFloat widthAvailable;
+	CGFloat fontSize;
+	BOOL justified;
+} PINCHTextLayoutSubstitutedLineKey;
+
+/// A link in the attributedString, as stored in the sorted index of links of a textLayout
+typedef struct {
+	/// The range the link is underlined in
+	NSRange range;
+	/// The range reported with the link, the full range of the textCheckingResult for detected data
+	NSRange reportedRange;
+	/// Whether the value of the link is an NSTextCheckingResult instead of an NSURL
+	BOOL textCheckingResult;
+} PINCHTextLayoutLinkRange;
+
+/// Returns the index of the first link that ends after location, links are sorted and don't overlap
+static NSUInteger PINCHTextLayoutLinkRangeIndexAfterLocation(const PINCHTextLayoutLinkRange *linkRanges, NSUInteger numberOfLinkRanges, NSUInteger location)
+{
+	NSUInteger lower = 0;
+	NSUInteger upper = numberOfLinkRanges;
+	while (lower < upper)
+	{
+		NSUInteger middle = lower + (upper - lower) / 2;
+		if (NSMaxRange(linkRanges[middle].range) <= location)
+		{
+			lower = middle + 1;
+		}
+		else
+		{
+			upper = middle;
+		}
+	}
+	return lower;
+}
+
+/// Horizontal extent of a glyph outline within the underline band, relative to the glyph origin
+typedef struct {
+	CGFloat minX;
+	CGFloat maxX;
+	BOOL intersects;
+} PINCHGlyphUnderlineInterval;
+
+/// Extent of the outline segments collected while applying a glyph path
+typedef struct {
+	CGFloat minY;
+	CGFloat maxY;
+	CGPoint currentPoint;
+	CGPoint subpathStart;
+	PINCHGlyphUnderlineInterval interval;
+} PINCHGlyphUnderlineBand;
+
+/// Number of straight segments a curve is flattened to, enough at underline distance from the baseline
+static NSUInteger underlineCurveSegments = 8;
+
+/// Extends the interval of band with the part of the straight segment between from and to that lies within the band
+static void PINCHGlyphUnderlineBandAddSegment(PINCHGlyphUnderlineBand *band, CGPoint from, CGPoint to)
+{
+	CGFloat minT = 0;
+	CGFloat maxT = 1;
+	CGFloat deltaY = to.y - from.y;
+	if (deltaY == 0)
+	{
+		if (from.y < band->minY || from.y > band->maxY)
+		{
+			return;
+		}
+	}
+	else
+	{
+		CGFloat lowerT = (band->minY - from.y) / deltaY;
+		CGFloat upperT = (band->maxY - from.y) / deltaY;
+		minT = MAX(minT, MIN(lowerT, upperT));
+		maxT = MIN(maxT, MAX(lowerT, upperT));
+		if (minT > maxT)
+		{
+			return;
+		}
+	}
+	
+	CGFloat deltaX = to.x - from.x;
+	CGFloat startX = from.x + deltaX * minT;
+	CGFloat endX = from.x + deltaX * maxT;
+	PINCHGlyphUnderlineInterval *interval = &band->interval;
+	interval->minX = (interval->intersects ? MIN(interval->minX, MIN(startX, endX)) : MIN(startX, endX));
+	interval->maxX = (interval->intersects ? MAX(interval->maxX, MAX(startX, endX)) : MAX(startX, endX));
+	interval->intersects = YES;
+}
+
+static void PINCHGlyphUnderlineBandApplyElement(void *info, const CGPathElement *element)
+{
+	PINCHGlyphUnderlineBand *band = info;
+	CGPoint current = band->currentPoint;
+	CGPoint *points = element->points;
+	
+	switch (element->type)
+	{
+		case kCGPathElementMoveToPoint:
+			band->subpathStart = points[0];
+			band->currentPoint = points[0];
+			break;
+		case kCGPathElementAddLineToPoint:
+			PINCHGlyphUnderlineBandAddSegment(band, current, points[0]);
+			band->currentPoint = points[0];
+			break;
+		case kCGPathElementAddQuadCurveToPoint:
+		case kCGPathElementAddCurveToPoint:
+		{
+			// Flattened into straight segments, the outline only needs to be as precise as the gap around it
+			BOOL quadCurve = (element->type == kCGPathElementAddQuadCurveToPoint);
+			CGPoint end = (quadCurve ? points[1] : points[2]);
+			CGPoint previous = current;
+			for (NSUInteger segment = 1; segment <= underlineCurveSegments; segment++)
+			{
+				CGFloat t = (CGFloat)segment / underlineCurveSegments;
+				CGFloat u = 1 - t;
+				CGPoint point;
+				if (quadCurve)
+				{
+					point.x = u * u * current.x + 2 * u * t * points[0].x + t * t * end.x;
+					point.y = u * u * current.y + 2 * u * t * points[0].y + t * t * end.y;
+				}
+				else
+				{
+					point.x = u * u * u * current.x + 3 * u * u * t * points[0].x + 3 * u * t * t * points[1].x + t * t * t * end.x;
+					point.y = u * u * u * current.y + 3 * u * u * t * points[0].y + 3 * u * t * t * points[1].y + t * t * t * end.y;
+				}
+				PINCHGlyphUnderlineBandAddSegment(band, previous, point);
+				previous = point;
+			}
+			band->currentPoint = end;
+			break;
+		}
+		case kCGPathElementCloseSubpath:
+			PINCHGlyphUnderlineBandAddSegment(band, current, band->subpathStart);
+			band->currentPoint = band->subpathStart;
+			break;
+	}
+}
+
+/// The intervals of the glyphs of one font within one band, only of the glyphs that have been looked up
+@interface PINCHGlyphUnderlineIntervals : NSObject
+{
+	@public
+	/// Index in intervals plus one for glyph plus one, sparse since glyph IDs of CJK and emoji fonts go up to 65535
+	CFMutableDictionaryRef indexes;
+	NSMutableData *intervals;
+}
+
+@end
+
+@implementation PINCHGlyphUnderlineIntervals
+
+- (instancetype)init
+{
+	self = [super init];
+	if (self)
+	{
+		indexes = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+		intervals = [NSMutableData data];
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	CFRelease(indexes);
+}
+
+@end
+
+/// Returns the cached intervals of the glyphs of font within the band, created when first needed. Lock them while in use
+static PINCHGlyphUnderlineIntervals *PINCHGlyphUnderlineIntervalsForFont(CTFontRef font, CGFloat minY, CGFloat maxY)
+{
+	static NSCache *intervalCache = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		intervalCache = [[NSCache alloc] init];
+		intervalCache.countLimit = 16;
+	});
+	
+	NSString *fontName = CFBridgingRelease(CTFontCopyPostScriptName(font));
+	NSString *key = [NSString stringWithFormat:@"%@-%f-%f-%f", fontName, CTFontGetSize(font), minY, maxY];
+	PINCHGlyphUnderlineIntervals *intervals = [intervalCache objectForKey:key];
+	if (!intervals)
+	{
+		intervals = [[PINCHGlyphUnderlineIntervals alloc] init];
+		[intervalCache setObject:intervals forKey:key];
+	}
+	return intervals;
+}
+
+/// Returns the horizontal extent of the outline of glyph between minY and maxY, relative to the glyph origin,
+/// from the intervals cached for the font. Glyphs without an outline, like emoji, use their bounding box
+static PINCHGlyphUnderlineInterval PINCHGlyphUnderlineIntervalForGlyph(PINCHGlyphUnderlineIntervals *intervals, CTFontRef font, CGGlyph glyph, CGFloat minY, CGFloat maxY)
+{
+	const void *glyphKey = (const void *)((uintptr_t)glyph + 1);
+	uintptr_t index = (uintptr_t)CFDictionaryGetValue(intervals->indexes, glyphKey);
+	if (index > 0)
+	{
+		return ((const PINCHGlyphUnderlineInterval *)[intervals->intervals bytes])[index - 1];
+	}
+	
+	PINCHGlyphUnderlineBand band;
+	memset(&band, 0, sizeof(band));
+	band.minY = minY;
+	band.maxY = maxY;
+	
+	CGPathRef path = CTFontCreatePathForGlyph(font, glyph, NULL);
+	if (path != NULL)
+	{
+		CGPathApply(path, &band, PINCHGlyphUnderlineBandApplyElement);
+		CGPathRelease(path);
+	}
+	else
+	{
+		CGRect boundingRect = CTFontGetBoundingRectsForGlyphs(font, kCTFontOrientationHorizontal, &glyph, NULL, 1);
+		if (!CGRectIsEmpty(boundingRect) && CGRectGetMinY(boundingRect) <= maxY && CGRectGetMaxY(boundingRect) >= minY)
+		{
+			band.interval.minX = CGRectGetMinX(boundingRect);
+			band.interval.maxX = CGRectGetMaxX(boundingRect);
+			band.interval.intersects = YES;
+		}
+	}
+	
+	PINCHGlyphUnderlineInterval interval = band.interval;
+	[intervals->intervals appendBytes:&interval length:sizeof(interval)];
+	CFDictionarySetValue(intervals->indexes, glyphKey, (const void *)(uintptr_t)([intervals->intervals length] / sizeof(interval)));
+	return interval;
+}
+
+/// Sorts intervals by their start
+static int PINCHGlyphUnderlineIntervalCompare(const void *first, const void *second)
+{
+	CGFloat firstMinX = ((const PINCHGlyphUnderlineInterval *)first)->minX;
+	CGFloat secondMinX = ((const PINCHGlyphUnderlineInterval *)second)->minX;
+	return (firstMinX < secondMinX ? -1 : (firstMinX > secondMinX ? 1 : 0));
+}
+
+/// The smallest number of characters typeset to truncate the last line with
+static CFIndex minimumTruncationWindowLength = 64;
+
+/// Returns a retained line with the ellipsis in attributes, shared by all truncated lines with the same attributes
+static CTLineRef PINCHTruncationTokenCreateWithAttributes(NSDictionary *attributes)
+{
+	static NSCache *truncationTokenCache = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		truncationTokenCache = [[NSCache alloc] init];
+		truncationTokenCache.countLimit = 16;
+	});
+	
+	id truncationToken = [truncationTokenCache objectForKey:attributes];
+	if (!truncationToken)
+	{
+		NSAttributedString *truncationString = [[NSAttributedString alloc] initWithString:@"\u2026" attributes:attributes];
+		truncationToken = CFBridgingRelease(CTLineCreateWithAttributedString((__bridge CFAttributedStringRef)truncationString));
+		[truncationTokenCache setObject:truncationToken forKey:[attributes copy]];
+	}
+	return (CTLineRef)CFRetain((__bridge CTLineRef)truncationToken);
+}
+
+/// Returns the length of the first numberOfLines lines the framesetter breaks the string into at width, without typesetting any further
+static CFIndex PINCHFramesetterGetLengthOfLines(CTFramesetterRef framesetter, CFIndex numberOfLines, double width, CFIndex length)
+{
+	CTTypesetterRef typesetter = CTFramesetterGetTypesetter(framesetter);
+	CFIndex location = 0;
+	for (CFIndex lineIndex = 0; lineIndex < numberOfLines && location < length; lineIndex++)
+	{
+		CFIndex lineLength = CTTypesetterSuggestLineBreak(typesetter, location, width);
+		if (lineLength <= 0)
+		{
+			return length;
+		}
+		location += lineLength;
+	}
+	return MIN(location, length);
+}
+
 inline CFDictionaryRef PINCHFrameAttributesCreateWithClippingRect(CGRect clippingRect, CGAffineTransform transform)
 {
 	CGPathRef clipPath = CGPathCreateWithRect(clippingRect, &transform);
@@ -99,8 +391,10 @@ NSString *const PINCHTextLayoutMaximumNumberOfLinesAttribute = @"maximumNumberOf
 NSString *const PINCHTextLayoutTextInsetsAttribute = @"textInsets";
 NSString *const PINCHTextLayoutClippingRectInsetsAttribute = @"clippingRectInsets";
 NSString *const PINCHTextLayoutMinimumScaleFactorAttribute = @"minimumScaleFactor";
+NSString *const PINCHTextLayoutScaleFactorPrecisionAttribute = @"scaleFactorPrecision";
 NSString *const PINCHTextLayoutBreaksLastLineAttribute = @"breaksLastLine";
 NSString *const PINCHTextLayoutHyphenatedAttribute = @"hyphenated";
+NSString *const PINCHTextLayoutHyphenationLanguageAttribute = @"hyphenationLanguage";
 NSString *const PINCHTextLayoutLastLineInsetAttribute = @"lastLineInset";
 NSString *const PINCHTextLayoutUnderlinedAttribute = @"underlined";
 NSString *const PINCHTextLayoutPrefersNonWrappedWords = @"prefersNonWrappedWords";
@@ -129,14 +423,51 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 
 @end
 
+@interface PINCHTextLayoutResult ()
+
+- (instancetype)initWithProposedRect:(CGRect)proposedRect clippingRect:(CGRect)clippingRect boundingRect:(CGRect)boundingRect scaleFactor:(CGFloat)scaleFactor numberOfLines:(NSUInteger)numberOfLines fitsProposedRect:(BOOL)fitsProposedRect truncated:(BOOL)truncated attributedString:(NSAttributedString *)attributedString lines:(NSArray *)lines lineData:(NSData *)lineData drawingAttributes:(PINCHTextLayoutDrawingAttributes)drawingAttributes linkRangeData:(NSData *)linkRangeData linkValues:(NSArray *)linkValues;
+@property (nonatomic, copy, readonly) NSArray *lines;
+@property (nonatomic, copy, readonly) NSData *linkRangeData;
+@property (nonatomic, copy, readonly) NSArray *linkValues;
+
+@end
+
+/// The string typeset at a single scale factor, kept while the best fitting scale factor is searched for
+@interface PINCHTextLayoutTrial : NSObject
+
+/// The size of the lines within the maximum number of lines
+@property (nonatomic, assign) CGSize size;
+
+/// The CTLineRef objects of all typeset lines
+@property (nonatomic, copy) NSArray *lines;
+
+/// Contiguous PINCHTextLayoutLine structs of all typeset lines
+@property (nonatomic, copy) NSData *lineData;
+
+/// The number of lines that will be drawn
+@property (nonatomic, assign) NSUInteger numberOfLines;
+
+/// The index of the last line that will be drawn, -1 when there are no lines
+@property (nonatomic, assign) NSInteger lastLineIndex;
+
+/// Whether the string doesn't fit in the lines that will be drawn
+@property (nonatomic, assign, getter = isCappedString) BOOL cappedString;
+
+@end
+
+@implementation PINCHTextLayoutTrial
+
+@end
+
 @interface PINCHTextLayout ()
 
 @property (nonatomic, strong, readwrite) NSAttributedString *attributedString;
+@property (atomic, strong, readwrite) PINCHTextLayoutResult *layoutResult;
 @property (atomic, assign, getter = isFramesetterInvalid) BOOL framesetterInvalid;
 @property (nonatomic, copy, readwrite) NSArray *lineRects;
 @property (nonatomic, assign, readwrite) BOOL stringFitsProposedRect;
 @property (nonatomic, assign, readwrite) CGFloat actualScaleFactor;
-@property (nonatomic, strong) NSDataDetector *dataDetector;
+@property (atomic, strong) NSOperation *dataDetectionOperation;
 
 @end
 
@@ -146,13 +477,20 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 	NSMutableAttributedString *_attributedString;
 	
 	// Custom setters and getter require actual instance variables
-	CTFramesetterRef _framesetter;
 	BOOL _framesetterInvalid;
 	
-	// Saving calculation rects
-	CGRect _boundingRect;
-	CGRect _proposedRect;
-	CGRect _clippingRect;
+	// Framesetters keyed by fontSize and lineHeight, least recently used key first
+	NSMutableDictionary *_framesetters;
+	NSMutableArray *_framesetterKeys;
+	
+	// Saving calculation results, least recently used first
+	NSMutableArray *_layoutCache;
+	
+	// Scale factor fitting, steps are counted down from a scale factor of 1.0
+	NSMutableDictionary *_scaleFactorTrials;
+	NSInteger _cappedScaleFactorStep;
+	NSInteger _fittingScaleFactorStep;
+	CGFloat _previousFittedScaleFactor;
 	
 	// String properties stored locally
 	CGFloat _kerning;
@@ -161,6 +499,14 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 	
 	/// What modified keypaths should invalidate framesetter
 	NSArray *_keyPathsToObserve;
+	
+	// Sorted PINCHTextLayoutLinkRange structs of all links with their NSURL or NSTextCheckingResult values,
+	// replaced together while _attributedString is locked
+	NSData *_linkRangeData;
+	NSArray *_linkValues;
+	
+	// Hyphenated and justified lines keyed by their index in the drawn lines, reused while the geometry of the line is the same
+	NSMutableDictionary *_substitutedLines;
 }
 
 #pragma mark - Initializing and setters
@@ -188,8 +534,10 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 		_textInsets = [[attributes objectForKey:PINCHTextLayoutTextInsetsAttribute] UIEdgeInsetsValue];
 		_clippingRectInsets = [[attributes objectForKey:PINCHTextLayoutClippingRectInsetsAttribute] UIEdgeInsetsValue];
 		_minimumScaleFactor = [[attributes objectForKey:PINCHTextLayoutMinimumScaleFactorAttribute] doubleValue];
+		_scaleFactorPrecision = [[attributes objectForKey:PINCHTextLayoutScaleFactorPrecisionAttribute] doubleValue];
 		_breaksLastLine = [[attributes objectForKey:PINCHTextLayoutBreaksLastLineAttribute] boolValue];
 		_hyphenated = [[attributes objectForKey:PINCHTextLayoutHyphenatedAttribute] boolValue];
+		_hyphenationLanguage = [[attributes objectForKey:PINCHTextLayoutHyphenationLanguageAttribute] copy];
 		_lastLineInset = [[attributes objectForKey:PINCHTextLayoutLastLineInsetAttribute] doubleValue];
 		_underlined = [[attributes objectForKey:PINCHTextLayoutUnderlinedAttribute] boolValue];
 		_prefersNonWrappedWords = [[attributes objectForKey:PINCHTextLayoutPrefersNonWrappedWords] boolValue];
@@ -276,9 +624,19 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 	[stringAttributes setObject:[paragraphStyle copy] forKey:NSParagraphStyleAttributeName];
 	
 	_attributedString = [[NSMutableAttributedString alloc] initWithString:string attributes:[stringAttributes copy]];
+	_scaleFactorTrials = [@{} mutableCopy];
+	_layoutCache = [@[] mutableCopy];
+	_substitutedLines = [@{} mutableCopy];
+	_framesetters = [@{} mutableCopy];
+	_framesetterKeys = [@[] mutableCopy];
 	
 	[self parseMarkdown];
 	
+	if (_hyphenated && _hyphenationLanguage)
+	{
+		[self insertHyphenationPoints];
+	}
+	
 #if TARGET_OS_IOS
 	if (_dataDetectorTypes != UIDataDetectorTypeNone)
 	{
@@ -290,7 +648,7 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 	[self invalidateLayoutCache];
 	
 	// Add observers to invalidate cache when changed
-	_keyPathsToObserve = @[@"maximumNumberOfLines", @"textInsets", @"clippingRectInsets", @"minimumScaleFactor", @"breaksLastLine", @"hyphenated", @"lastLineInset", @"firstLineInset", @"positionsFirstLineHeadIndentRelatively", @"underlined"];
+	_keyPathsToObserve = @[@"maximumNumberOfLines", @"textInsets", @"clippingRectInsets", @"minimumScaleFactor", @"scaleFactorPrecision", @"breaksLastLine", @"hyphenated", @"lastLineInset", @"firstLineInset", @"positionsFirstLineHeadIndentRelatively", @"underlined"];
 	
 	[_keyPathsToObserve enumerateObjectsUsingBlock:^(id obj, NSUInteger index, BOOL *stop) {
 		NSString *keyPath = obj;
@@ -306,66 +664,76 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 		[self removeObserver:self forKeyPath:keyPath];
 	}];
 	[self removeFramesetter];
+	[_dataDetectionOperation cancel];
 }
 
 #pragma mark - Framesetter creation
 
 - (void)removeFramesetter
 {
-	if (_framesetter != NULL)
+	@synchronized(_framesetters)
 	{
-		void(^framesetterBlock)(void) = ^(void) {
-			if (_framesetter != NULL)
-			{
-				@synchronized(self)
-				{
-					CFRelease(_framesetter);
-					_framesetter = NULL;
-				}
-			}
-		};
-		
-		if (dispatch_get_specific(&queueKey))
-		{
-			framesetterBlock();
-		}
-		else
-		{
-			dispatch_sync(pinch_framesetterQueue(), framesetterBlock);
-			
-		}
+		[_framesetters removeAllObjects];
+		[_framesetterKeys removeAllObjects];
 	}
 }
 
 - (CTFramesetterRef)framesetter
 {
-	__block CTFramesetterRef framesetter = NULL;
+	return [self framesetterWithScaleFactor:self.actualScaleFactor];
+}
+
+/// Returns the framesetter for the string at the given scale factor. Framesetters are cached per fontSize and lineHeight,
+/// so going back to a scale factor that was used before doesn't need the string to be typeset again.
+/// Only the framesetters of this layout are locked, so other layouts can be measured on other threads at the same time.
+- (CTFramesetterRef)framesetterWithScaleFactor:(CGFloat)scaleFactor
+{
+	CTFramesetterRef framesetter = NULL;
 	
-	void(^framesetterBlock)(void) = ^(void) {
-		
-		if (_framesetterInvalid)
+	BOOL scaleFactorApplied = (scaleFactor == self.actualScaleFactor);
+	CGFloat fontSize = (scaleFactorApplied ? _fontSize : roundf(_initialFontSize * scaleFactor));
+	CGFloat lineHeight = (scaleFactorApplied ? _lineHeight : roundf(_initialLineHeight * scaleFactor));
+	NSValue *key = [NSValue valueWithCGSize:CGSizeMake(fontSize, lineHeight)];
+	
+	@synchronized(_framesetters)
+	{
+		if (self.framesetterInvalid)
 		{
 			[self removeFramesetter];
-			_framesetterInvalid = NO;
+			self.framesetterInvalid = NO;
 		}
 		
-		if (_framesetter == NULL)
+		id cachedFramesetter = _framesetters[key];
+		if (cachedFramesetter == nil)
 		{
-			@synchronized(_attributedString)
+			NSAttributedString *attributedString = nil;
+			if (scaleFactorApplied)
+			{
+				@synchronized(_attributedString)
+				{
+					attributedString = [_attributedString copy];
+				}
+			}
+			else
+			{
+				attributedString = [self attributedStringWithScaleFactor:scaleFactor];
+			}
+			
+			cachedFramesetter = CFBridgingRelease(CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)attributedString));
+			
+			_framesetters[key] = cachedFramesetter;
+			if ([_framesetterKeys count] >= maximumNumberOfCachedFramesetters)
 			{
-				_framesetter = CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)_attributedString);
+				[_framesetters removeObjectForKey:_framesetterKeys[0]];
+				[_framesetterKeys removeObjectAtIndex:0];
 			}
 		}
-		framesetter = _framesetter;
-	};
-	
-	if (dispatch_get_specific(&queueKey))
-	{
-		framesetterBlock();
-	}
-	else
-	{
-		dispatch_sync(pinch_framesetterQueue(), framesetterBlock);
+		
+		[_framesetterKeys removeObject:key];
+		[_framesetterKeys addObject:key];
+		
+		// Keep the framesetter alive for the caller when it gets evicted from the cache on an other thread
+		framesetter = (CTFramesetterRef)CFAutorelease(CFRetain((__bridge CFTypeRef)cachedFramesetter));
 	}
 	
 	return framesetter;
@@ -375,14 +743,26 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 
 - (void)invalidateLayoutCache
 {
-	_boundingRect = CGRectZero;
-	_proposedRect = CGRectZero;
+	@synchronized(_layoutCache)
+	{
+		[_layoutCache removeAllObjects];
+	}
+	[self removeSubstitutedLines];
+	self.layoutResult = nil;
 	self.lineRects = nil;
 	self.actualScaleFactor = 1.0f;
 	self.actualNumberOfLines = 0;
 	self.stringFitsProposedRect = YES;
 }
 
+- (void)removeSubstitutedLines
+{
+	@synchronized(_substitutedLines)
+	{
+		[_substitutedLines removeAllObjects];
+	}
+}
+
 - (void)setFramesetterInvalid
 {
 	self.framesetterInvalid = YES;
@@ -431,7 +811,7 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 		}
 	}
 	
-	[self setFramesetterInvalid];
+	// The lineHeight is part of the framesetter cache key, so the framesetter stays valid
 }
 
 - (void)setFontSize:(CGFloat)fontSize
@@ -463,7 +843,7 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 		}
 	}
 	
-	[self setFramesetterInvalid];
+	// The fontSize is part of the framesetter cache key, so the framesetter stays valid
 }
 
 - (void)setFont:(UIFont *)font
@@ -485,6 +865,32 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 	[self setFramesetterInvalid];
 }
 
+- (NSAttributedString *)attributedStringWithScaleFactor:(CGFloat)scaleFactor
+{
+	NSMutableAttributedString *attributedString = nil;
+	@synchronized(_attributedString)
+	{
+		attributedString = [_attributedString mutableCopy];
+	}
+	
+	NSRange range = NSMakeRange(0, attributedString.length);
+	if (range.length > 0)
+	{
+		UIFont *font = [attributedString attribute:NSFontAttributeName atIndex:0 effectiveRange:NULL];
+		UIFont *scaledFont = [UIFont fontWithName:font.fontName size:roundf(_initialFontSize * scaleFactor)];
+		
+		NSMutableParagraphStyle *paragraphStyle = [[attributedString attribute:NSParagraphStyleAttributeName atIndex:0 effectiveRange:NULL] mutableCopy];
+		CGFloat lineHeight = roundf(_initialLineHeight * scaleFactor);
+		paragraphStyle.minimumLineHeight = lineHeight;
+		paragraphStyle.maximumLineHeight = lineHeight;
+		
+		[attributedString addAttribute:NSFontAttributeName value:scaledFont range:range];
+		[attributedString addAttribute:NSParagraphStyleAttributeName value:[paragraphStyle copy] range:range];
+	}
+	
+	return attributedString;
+}
+
 - (void)setTextAlignment:(NSTextAlignment)textAlignment
 {
 	if (textAlignment == _textAlignment)
@@ -503,6 +909,10 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 			[_attributedString addAttribute:NSParagraphStyleAttributeName value:[paragraphStyle copy] range:range];
 		}
 	}
+	
+	// Cached framesetters have been created with the previous alignment
+	[self invalidateLayoutCache];
+	[self setFramesetterInvalid];
 }
 
 #pragma mark - KVO setters
@@ -544,29 +954,54 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 			[_attributedString removeAttribute:PINCHTextLayoutTextCheckingResultAttribute range:range];
 			[_attributedString removeAttribute:NSUnderlineStyleAttributeName range:range];
 		}];
+		[self updateLinkRanges];
+		
+		// Results of the previous types or string are no longer needed
+		[self.dataDetectionOperation cancel];
+		self.dataDetectionOperation = nil;
 		
 		if (self.dataDetectorTypes != UIDataDetectorTypeNone) {
 			NSTextCheckingTypes textCheckingTypes = PINCHTextCheckingTypeFromUIDataDetectorType(self.dataDetectorTypes);
-			if (self.dataDetector == nil || self.dataDetector.checkingTypes != textCheckingTypes)
-			{
-				self.dataDetector = [NSDataDetector dataDetectorWithTypes:textCheckingTypes error:nil];
-			}
-			
-			PINCHTextWeakObject(self, weakSelf);
-			void(^checkingBlock)(void) = ^{
-				NSArray *results = [weakSelf.dataDetector matchesInString:_attributedString.string options:0 range:NSMakeRange(0, [_attributedString length])];
-				dispatch_async(dispatch_get_main_queue(), ^{
-					[weakSelf applyTextCheckingResults:results];
-				});
-			};
+			PINCHTextDataDetector *dataDetector = [PINCHTextDataDetector sharedDataDetector];
+			NSString *string = [_attributedString.string copy];
 			
 			if ([[NSThread currentThread] isMainThread])
 			{
-				dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), checkingBlock);
+				NSArray *cachedResults = [dataDetector cachedResultsInString:string checkingTypes:textCheckingTypes];
+				if (cachedResults)
+				{
+					[self applyTextCheckingResults:cachedResults];
+					return;
+				}
+				
+				PINCHTextWeakObject(self, weakSelf);
+				self.dataDetectionOperation = [dataDetector detectResultsInString:string checkingTypes:textCheckingTypes completion:^(NSArray *results) {
+					PINCHTextLayout *strongSelf = weakSelf;
+					if (!strongSelf)
+					{
+						return;
+					}
+					
+					// The string or the types might have changed while scanning
+					BOOL stringChanged = NO;
+					@synchronized(strongSelf->_attributedString)
+					{
+						stringChanged = ![strongSelf->_attributedString.string isEqualToString:string];
+					}
+					if (!stringChanged && PINCHTextCheckingTypeFromUIDataDetectorType(strongSelf.dataDetectorTypes) == textCheckingTypes)
+					{
+						strongSelf.dataDetectionOperation = nil;
+						[strongSelf applyTextCheckingResults:results];
+					}
+				}];
 			}
 			else
 			{
-				checkingBlock();
+				NSArray *results = [dataDetector resultsInString:string checkingTypes:textCheckingTypes];
+				PINCHTextWeakObject(self, weakSelf);
+				dispatch_async(dispatch_get_main_queue(), ^{
+					[weakSelf applyTextCheckingResults:results];
+				});
 			}
 		}
 	}
@@ -587,6 +1022,7 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 			[_attributedString addAttribute:NSUnderlineStyleAttributeName value:@1 range:result.range];
 			[_attributedString addAttribute:PINCHTextLayoutTextCheckingResultAttribute value:result range:result.range];
 		}];
+		[self updateLinkRanges];
 		
 		[self invalidateLayoutCache];
 		[self setFramesetterInvalid];
@@ -599,91 +1035,211 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 }
 #endif
 
+/// Replaces markdown links like [name](URL) with their names in a single pass over the string, and marks the names as links.
+/// The text between the links is copied with its attributes, so every character is visited once
 - (void)parseMarkdown
 {
 	@synchronized(_attributedString)
 	{
-		NSRange searchRange = NSMakeRange(0, _attributedString.length);
+		NSUInteger length = _attributedString.length;
+		NSRange searchRange = NSMakeRange(0, length);
 		[_attributedString removeAttribute:NSUnderlineStyleAttributeName range:searchRange];
 		[_attributedString removeAttribute:PINCHTextLayoutURLStringAttribute range:searchRange];
 		
-		NSScanner *scanner = [NSScanner scannerWithString:_attributedString.string];
-		NSString *scannedString = nil;
+		NSString *string = _attributedString.string;
+		if ([string rangeOfString:@"](" options:NSLiteralSearch].location == NSNotFound)
+		{
+			[self updateLinkRanges];
+			return;
+		}
+		
+		unichar *characters = malloc(sizeof(unichar) * length);
+		[string getCharacters:characters range:searchRange];
 		
-		NSMutableArray *foundURLS = [@[] mutableCopy];
+		NSMutableAttributedString *parsedString = [[NSMutableAttributedString alloc] init];
+		NSMutableArray *links = [NSMutableArray array];
+		NSUInteger copiedLocation = 0;
+		NSUInteger location = 0;
+		NSUInteger searchedURLEnd = 0;
 		
-		while (![scanner isAtEnd])
+		while (location < length)
 		{
-			[scanner scanUpToString:@"[" intoString:&scannedString];
-			
-			NSRange URLRange = NSMakeRange([scanner scanLocation], 0);
-			NSString *URLNameString = nil;
-			NSString *tag = nil;
+			if (characters[location] != '[')
+			{
+				location++;
+				continue;
+			}
 			
-			if ([scanner isAtEnd])
+			// The name runs up to the first closing bracket, and needs to be followed by the URL in parentheses
+			NSUInteger nameStart = location + 1;
+			NSUInteger nameEnd = nameStart;
+			while (nameEnd < length && characters[nameEnd] != ']')
+			{
+				nameEnd++;
+			}
+			// Every opening bracket up to nameEnd has the same closing bracket and URL, so they would fail as well
+			NSUInteger URLStart = nameEnd + 2;
+			if (nameEnd == nameStart || URLStart > length || characters[nameEnd + 1] != '(')
 			{
-				break;
+				location = nameEnd;
+				continue;
 			}
-			[scanner setScanLocation:[scanner scanLocation] + 1];
 			
-			if([scanner scanUpToString:@"]" intoString:&URLNameString])
+			// There is no closing parenthesis between an earlier URLStart and where its search ended,
+			// so text without one is only searched once
+			NSUInteger URLEnd = MAX(URLStart, searchedURLEnd);
+			while (URLEnd < length && characters[URLEnd] != ')')
 			{
-				URLRange.length = [scanner scanLocation] - URLRange.location;
-				
-				if ([scanner isAtEnd])
-				{
-					break;
-				}
-				[scanner setScanLocation:NSMaxRange(URLRange)];
-				
-				NSString *spacing = nil;
-				if ([scanner scanUpToString:@"(" intoString:&spacing])
-				{
-					if ([spacing length] == 1)
-					{
-						NSString *URLString;
-						if ([scanner isAtEnd])
-						{
-							break;
-						}
-						[scanner setScanLocation:[scanner scanLocation] + 1];
-						if ([scanner scanUpToString:@")" intoString:&URLString])
-						{
-							tag = [NSString stringWithFormat:@"[%@](%@)", URLNameString, URLString];
-							NSURL *URL = [NSURL URLWithString:URLString];
-							[foundURLS addObject:@{@"Tag": tag, @"URL": URL, @"URLName": URLNameString}];
-						}
-					}
-				}
+				URLEnd++;
 			}
-		}
-		
-		[foundURLS enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
-			NSDictionary *foundURL = obj;
-			NSString *tag = foundURL[@"Tag"];
-			NSURL *URL = foundURL[@"URL"];
-			NSString *urlName = foundURL[@"URLName"];
+			searchedURLEnd = URLEnd;
 			
-			NSRange tagRange = [_attributedString.string rangeOfString:tag];
-			[_attributedString replaceCharactersInRange:tagRange withString:urlName];
+			NSURL *URL = nil;
+			if (URLEnd < length && URLEnd > URLStart)
+			{
+				URL = [NSURL URLWithString:[NSString stringWithCharacters:characters + URLStart length:URLEnd - URLStart]];
+			}
+			if (!URL)
+			{
+				location = nameEnd;
+				continue;
+			}
 			
-			NSRange linkRange = NSMakeRange(tagRange.location, [urlName length]);
+			// Text before the link and the name, with the attributes they had
+			if (location > copiedLocation)
+			{
+				[parsedString appendAttributedString:[_attributedString attributedSubstringFromRange:NSMakeRange(copiedLocation, location - copiedLocation)]];
+			}
+			NSRange linkRange = NSMakeRange(parsedString.length, nameEnd - nameStart);
+			[parsedString appendAttributedString:[_attributedString attributedSubstringFromRange:NSMakeRange(nameStart, nameEnd - nameStart)]];
+			[links addObject:@{@"Range": [NSValue valueWithRange:linkRange], @"URL": URL}];
 			
-			[_attributedString addAttribute:NSUnderlineStyleAttributeName value:@(1) range:linkRange];
-			[_attributedString addAttribute:PINCHTextLayoutURLStringAttribute value:URL range:linkRange];
-		}];
+			location = URLEnd + 1;
+			copiedLocation = location;
+		}
+		free(characters);
 		
+		if ([links count] > 0)
+		{
+			if (copiedLocation < length)
+			{
+				[parsedString appendAttributedString:[_attributedString attributedSubstringFromRange:NSMakeRange(copiedLocation, length - copiedLocation)]];
+			}
+			[_attributedString setAttributedString:parsedString];
+			
+			for (NSDictionary *link in links)
+			{
+				NSRange linkRange = [link[@"Range"] rangeValue];
+				[_attributedString addAttribute:NSUnderlineStyleAttributeName value:@(1) range:linkRange];
+				[_attributedString addAttribute:PINCHTextLayoutURLStringAttribute value:link[@"URL"] range:linkRange];
+			}
+		}
+		[self updateLinkRanges];
 	}
 }
 
-#pragma mark - Size calculation
-
-- (CGRect)boundingRectForProposedRect:(CGRect)proposedRect withClippingRect:(CGRect *)clippingRect containerRect:(CGRect)containerRect
+/// Inserts soft hyphens at the hyphenation points found by the hyphenator of hyphenationLanguage.
+/// The string is rebuilt in one pass, every soft hyphen gets the attributes of the character before it so links stay intact
+- (void)insertHyphenationPoints
 {
-	UIEdgeInsets textInsets = self.textInsets;
-	UIEdgeInsets clippingInsets = self.clippingRectInsets;
-	
-	if (CGRectGetWidth(proposedRect) == CGFLOAT_MAX)
+	PINCHTextHyphenator *hyphenator = [PINCHTextHyphenator hyphenatorForLanguage:_hyphenationLanguage];
+	if (!hyphenator)
+	{
+		return;
+	}
+	
+	@synchronized(_attributedString)
+	{
+		NSIndexSet *indexes = [hyphenator hyphenationIndexesInString:_attributedString.string];
+		if ([indexes count] == 0)
+		{
+			return;
+		}
+		
+		NSMutableAttributedString *hyphenatedString = [[NSMutableAttributedString alloc] init];
+		__block NSUInteger copiedLocation = 0;
+		[indexes enumerateIndexesUsingBlock:^(NSUInteger index, BOOL *stop) {
+			[hyphenatedString appendAttributedString:[_attributedString attributedSubstringFromRange:NSMakeRange(copiedLocation, index - copiedLocation)]];
+			NSDictionary *attributes = [_attributedString attributesAtIndex:index - 1 effectiveRange:NULL];
+			[hyphenatedString appendAttributedString:[[NSAttributedString alloc] initWithString:@"\u00AD" attributes:attributes]];
+			copiedLocation = index;
+		}];
+		[hyphenatedString appendAttributedString:[_attributedString attributedSubstringFromRange:NSMakeRange(copiedLocation, _attributedString.length - copiedLocation)]];
+		[_attributedString setAttributedString:hyphenatedString];
+		
+		[self updateLinkRanges];
+	}
+}
+
+/// Indexes the links in the attributedString, so drawing doesn't need to search the attributes of every line for them.
+/// Links are sorted by location, where a URL and a textCheckingResult overlap the URL is used
+- (void)updateLinkRanges
+{
+	@synchronized(_attributedString)
+	{
+		// Links change the attributes the substituted lines have been created with
+		[self removeSubstitutedLines];
+		
+		NSMutableData *linkRangeData = [NSMutableData data];
+		NSMutableArray *linkValues = [NSMutableArray array];
+		
+		[_attributedString enumerateAttributesInRange:NSMakeRange(0, _attributedString.length) options:0 usingBlock:^(NSDictionary *attributes, NSRange range, BOOL *stop) {
+			id value = attributes[PINCHTextLayoutURLStringAttribute];
+			NSTextCheckingResult *result = nil;
+			if (!value)
+			{
+				value = result = attributes[PINCHTextLayoutTextCheckingResultAttribute];
+			}
+			if (!value || !attributes[NSUnderlineStyleAttributeName])
+			{
+				return;
+			}
+			
+			// Runs are split by other attributes, consecutive runs of the same link are combined
+			PINCHTextLayoutLinkRange *previousLinkRange = ([linkValues count] > 0 ? (PINCHTextLayoutLinkRange *)[linkRangeData mutableBytes] + [linkValues count] - 1 : NULL);
+			if (previousLinkRange != NULL && [linkValues lastObject] == value && NSMaxRange(previousLinkRange->range) == range.location)
+			{
+				previousLinkRange->range.length += range.length;
+				if (!result)
+				{
+					previousLinkRange->reportedRange = previousLinkRange->range;
+				}
+				return;
+			}
+			
+			PINCHTextLayoutLinkRange linkRange;
+			memset(&linkRange, 0, sizeof(linkRange));
+			linkRange.range = range;
+			linkRange.reportedRange = (result ? result.range : range);
+			linkRange.textCheckingResult = (result != nil);
+			[linkRangeData appendBytes:&linkRange length:sizeof(linkRange)];
+			[linkValues addObject:value];
+		}];
+		
+		_linkRangeData = [linkRangeData copy];
+		_linkValues = [linkValues copy];
+	}
+}
+
+#pragma mark - Size calculation
+
+- (CGRect)boundingRectForProposedRect:(CGRect)proposedRect withClippingRect:(CGRect *)clippingRect containerRect:(CGRect)containerRect
+{
+	return [self layoutResultForProposedRect:proposedRect withClippingRect:clippingRect containerRect:containerRect].boundingRect;
+}
+
+- (PINCHTextLayoutResult *)layoutResultForProposedRect:(CGRect)proposedRect withClippingRect:(CGRect *)clippingRect containerRect:(CGRect)containerRect
+{
+	return [self layoutResultForProposedRect:proposedRect withClippingRect:clippingRect containerRect:containerRect cancelToken:nil];
+}
+
+/// Checks cancelToken before typesetting every scale factor, returns nil without changing the layout when it has been cancelled
+- (PINCHTextLayoutResult *)layoutResultForProposedRect:(CGRect)proposedRect withClippingRect:(CGRect *)clippingRect containerRect:(CGRect)containerRect cancelToken:(PINCHTextPrefetchToken *)cancelToken
+{
+	UIEdgeInsets textInsets = self.textInsets;
+	UIEdgeInsets clippingInsets = self.clippingRectInsets;
+	
+	if (CGRectGetWidth(proposedRect) == CGFLOAT_MAX)
 	{
 		proposedRect.size.width = 100000;
 	}
@@ -698,259 +1254,895 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 		*clippingRect = UIEdgeInsetsInsetRect(*clippingRect, PINCHEdgeInsetsInvert(clippingInsets));
 	}
 	
-	if (CGRectEqualToRect(proposedRect, _proposedRect) && CGRectEqualToRect(*clippingRect, _clippingRect))
+	// Empty clippingRects all have the same result
+	CGRect normalizedClippingRect = (CGRectIsEmpty(*clippingRect) ? CGRectZero : CGRectStandardize(*clippingRect));
+	
+	// Trials, scale factor steps and the applied result are shared by every measurement of this textLayout
+	@synchronized(self)
+	{
+		PINCHTextLayoutResult *cachedResult = [self cachedLayoutResultWithProposedRect:proposedRect clippingRect:normalizedClippingRect];
+		if (cachedResult)
+		{
+			// Apply the cached results without typesetting, moved to the origin of the proposed rect
+			CGRect cachedProposedRect = cachedResult.proposedRect;
+			cachedResult = [cachedResult layoutResultWithOffset:CGPointMake(CGRectGetMinX(proposedRect) - CGRectGetMinX(cachedProposedRect), CGRectGetMinY(proposedRect) - CGRectGetMinY(cachedProposedRect))];
+			[self applyLayoutResult:cachedResult];
+			return cachedResult;
+		}
+		
+		// Measurements without clippingRect are persisted between launches when there's a measurementCache
+		PINCHTextMeasurementCache *measurementCache = (CGRectIsEmpty(normalizedClippingRect) ? [PINCHTextMeasurementCache defaultCache] : nil);
+		uint64_t measurementKey = (measurementCache ? [self measurementKeyForProposedRect:proposedRect] : 0);
+		PINCHTextMeasurement measurement;
+		if (measurementCache && [measurementCache getMeasurement:&measurement forKey:measurementKey])
+		{
+			PINCHTextLayoutResult *persistedResult = [self layoutResultWithMeasurement:measurement proposedRect:proposedRect containerRect:containerRect];
+			[self applyLayoutResult:persistedResult];
+			[self cacheLayoutResult:persistedResult];
+			return persistedResult;
+		}
+		
+		CGRect fitRect = UIEdgeInsetsInsetRect(proposedRect, textInsets);
+		
+		CGRect calculatedRect = CGRectZero;
+		PINCHTextLayoutTrial *trial = nil;
+		NSAttributedString *attributedString = nil;
+		NSData *linkRangeData = nil;
+		NSArray *linkValues = nil;
+		BOOL truncated = NO;
+		
+		if (fitRect.size.width > 0 && fitRect.size.height > 0)
+		{
+			CFIndex length;
+			
+			@synchronized(_attributedString)
+			{
+				length = (CFIndex)_attributedString.length;
+			}
+			
+			if (length == 0)
+			{
+				return [[PINCHTextLayoutResult alloc] initWithProposedRect:proposedRect clippingRect:CGRectZero boundingRect:CGRectZero scaleFactor:self.actualScaleFactor numberOfLines:0 fitsProposedRect:YES truncated:NO attributedString:nil lines:nil lineData:nil drawingAttributes:[self drawingAttributes] linkRangeData:nil linkValues:nil];
+			}
+			
+			CFDictionaryRef frameAttributes = NULL;
+			
+			CGAffineTransform transform = [self typesettingTransformWithContainerRect:containerRect];
+			
+			if (!CGRectIsEmpty(normalizedClippingRect))
+			{
+				frameAttributes = PINCHFrameAttributesCreateWithClippingRect(normalizedClippingRect, transform);
+			}
+			
+			CGSize size = CGSizeZero;
+			
+			BOOL shouldStopIteration = NO;
+			
+			// Every iteration is done at _trialScaleFactor, without touching the attributedString
+			_trialScaleFactor = 1.0f;
+			_cappedScaleFactorStep = -1;
+			_fittingScaleFactorStep = NSIntegerMax;
+			[_scaleFactorTrials removeAllObjects];
+			
+			while (shouldStopIteration == NO)
+			{
+				// Iterate while text doesn't fit proposed rect and minimumScaleFactor is set
+				CGFloat scaleFactor = _trialScaleFactor;
+				trial = _scaleFactorTrials[@(scaleFactor)];
+				if (!trial && cancelToken.isCancelled)
+				{
+					[_scaleFactorTrials removeAllObjects];
+					if (frameAttributes != NULL)
+					{
+						CFRelease(frameAttributes);
+					}
+					return nil;
+				}
+				else if (!trial)
+				{
+					trial = [self trialWithScaleFactor:scaleFactor fitRect:fitRect transform:transform frameAttributes:frameAttributes clipped:!CGRectIsEmpty(*clippingRect)];
+					_scaleFactorTrials[@(scaleFactor)] = trial;
+				}
+				
+				size = trial.size;
+				BOOL cappedString = trial.isCappedString;
+				
+				if (self.minimumScaleFactor == 0 || (!cappedString && scaleFactor == 1.0f))
+				{
+					self.actualScaleFactor = scaleFactor;
+					self.stringFitsProposedRect = !cappedString;
+					shouldStopIteration = YES;
+				}
+				else
+				{
+					size = [self handleBoundsCalculationIterationWithSize:size cappedString:cappedString shouldStop:&shouldStopIteration];
+				}
+			}
+			
+			// Use the lines of the trial that has been picked, which isn't necessarily the last one
+			trial = _scaleFactorTrials[@(self.actualScaleFactor)] ?: trial;
+			[_scaleFactorTrials removeAllObjects];
+			
+			// The links are indexed in the string that is copied, so they can be drawn from the result
+			@synchronized(_attributedString)
+			{
+				attributedString = [_attributedString copy];
+				linkRangeData = _linkRangeData;
+				linkValues = _linkValues;
+			}
+			
+			// The trials have been cleared, so the picked trial can be changed
+			truncated = [self truncateLastLineOfTrial:trial fitRect:fitRect clippingRect:normalizedClippingRect attributedString:attributedString];
+			
+			if (frameAttributes != NULL)
+			{
+				CFRelease(frameAttributes);
+			}
+			
+			calculatedRect.size = size;
+			calculatedRect.origin = fitRect.origin;
+			
+			if (size.width < CGRectGetWidth(fitRect))
+			{
+				if (_textAlignment == NSTextAlignmentRight)
+				{
+					calculatedRect.origin.x += CGRectGetWidth(fitRect) - size.width;
+				}
+				else if (_textAlignment == NSTextAlignmentCenter)
+				{
+					calculatedRect.origin.x = roundf(CGRectGetMidX(fitRect) - (size.width / 2));
+				}
+			}
+		}
+		
+		if (!CGRectIsEmpty(calculatedRect))
+		{
+			calculatedRect = UIEdgeInsetsInsetRect(calculatedRect, PINCHEdgeInsetsInvert(self.textInsets));
+		}
+		
+		PINCHTextLayoutResult *result = [[PINCHTextLayoutResult alloc] initWithProposedRect:proposedRect clippingRect:normalizedClippingRect boundingRect:calculatedRect scaleFactor:self.actualScaleFactor numberOfLines:trial.numberOfLines fitsProposedRect:self.stringFitsProposedRect truncated:truncated attributedString:attributedString lines:trial.lines lineData:trial.lineData drawingAttributes:[self drawingAttributes] linkRangeData:linkRangeData linkValues:linkValues];
+		[self applyLayoutResult:result];
+		[self cacheLayoutResult:result];
+		
+		if (measurementCache)
+		{
+			measurement.boundingRect = (CGRectIsEmpty(calculatedRect) ? CGRectZero : CGRectOffset(calculatedRect, -CGRectGetMinX(proposedRect), -CGRectGetMinY(proposedRect)));
+			measurement.scaleFactor = result.scaleFactor;
+			measurement.numberOfLines = result.numberOfLines;
+			measurement.fitsProposedRect = result.fitsProposedRect;
+			[measurementCache setMeasurement:measurement forKey:measurementKey];
+		}
+		
+		return result;
+	}
+}
+
+#pragma mark - Measurement cache
+
+/// Hashes the string and everything that influences its size, unscaled, together with the size of the proposed rect
+- (uint64_t)measurementKeyForProposedRect:(CGRect)proposedRect
+{
+	uint64_t key = PINCHTextMeasurementHashInitial;
+	
+	// Subclasses may measure differently
+	const char *className = [NSStringFromClass([self class]) UTF8String];
+	key = PINCHTextMeasurementHash(key, className, strlen(className));
+	
+	@synchronized(_attributedString)
+	{
+		CFStringRef string = (__bridge CFStringRef)_attributedString.string;
+		CFIndex length = CFStringGetLength(string);
+		const UniChar *characters = CFStringGetCharactersPtr(string);
+		if (characters != NULL)
+		{
+			key = PINCHTextMeasurementHash(key, characters, (size_t)length * sizeof(UniChar));
+		}
+		else
+		{
+			UniChar buffer[256];
+			for (CFIndex location = 0; location < length; location += 256)
+			{
+				CFRange range = CFRangeMake(location, MIN(256, length - location));
+				CFStringGetCharacters(string, range, buffer);
+				key = PINCHTextMeasurementHash(key, buffer, (size_t)range.length * sizeof(UniChar));
+			}
+		}
+	}
+	
+	const char *fontName = [_font.fontName UTF8String] ?: "";
+	key = PINCHTextMeasurementHash(key, fontName, strlen(fontName) + 1);
+	
+	struct {
+		CGFloat fontSize;
+		CGFloat lineHeight;
+		CGFloat kerning;
+		NSInteger textAlignment;
+		UIEdgeInsets textInsets;
+		NSUInteger maximumNumberOfLines;
+		CGFloat minimumScaleFactor;
+		CGFloat scaleFactorStepSize;
+		CGFloat lastLineInset;
+		BOOL breaksLastLine;
+		BOOL hyphenated;
+		BOOL prefersNonWrappedWords;
+		CGSize proposedSize;
+	} attributes;
+	memset(&attributes, 0, sizeof(attributes));
+	attributes.fontSize = _initialFontSize;
+	attributes.lineHeight = _initialLineHeight;
+	attributes.kerning = _kerning;
+	attributes.textAlignment = _textAlignment;
+	attributes.textInsets = self.textInsets;
+	attributes.maximumNumberOfLines = self.maximumNumberOfLines;
+	attributes.minimumScaleFactor = self.minimumScaleFactor;
+	attributes.scaleFactorStepSize = [self scaleFactorStepSize];
+	attributes.lastLineInset = self.lastLineInset;
+	attributes.breaksLastLine = self.breaksLastLine;
+	attributes.hyphenated = self.isHyphenated;
+	attributes.prefersNonWrappedWords = self.prefersNonWrappedWords;
+	attributes.proposedSize = proposedRect.size;
+	
+	return PINCHTextMeasurementHash(key, &attributes, sizeof(attributes));
+}
+
+/// Hashes everything that influences how the textLayout is drawn in rect: the measurementKey, the attributes of the
+/// attributedString including links and colors, the applied scaleFactor, the relative clippingRect and the scale
+- (uint64_t)bitmapKeyForRect:(CGRect)rect clippingRect:(CGRect)clippingRect scale:(CGFloat)scale
+{
+	__block uint64_t key = [self measurementKeyForProposedRect:rect];
+	
+	@synchronized(_attributedString)
+	{
+		[_attributedString enumerateAttributesInRange:NSMakeRange(0, _attributedString.length) options:0 usingBlock:^(NSDictionary *attributes, NSRange range, BOOL *stop) {
+			struct {
+				NSRange range;
+				NSInteger underlineStyle;
+				NSUInteger URLHash;
+				NSRange textCheckingRange;
+				CGFloat fontSize;
+				CGFloat colorComponents[4];
+			} run;
+			memset(&run, 0, sizeof(run));
+			run.range = range;
+			run.underlineStyle = [attributes[NSUnderlineStyleAttributeName] integerValue];
+			run.URLHash = [attributes[PINCHTextLayoutURLStringAttribute] hash];
+			run.textCheckingRange = [(NSTextCheckingResult *)attributes[PINCHTextLayoutTextCheckingResultAttribute] range];
+			run.fontSize = [(UIFont *)attributes[NSFontAttributeName] pointSize];
+			
+			CGColorRef color = [(UIColor *)attributes[NSForegroundColorAttributeName] CGColor];
+			if (color != NULL)
+			{
+				size_t numberOfComponents = MIN(CGColorGetNumberOfComponents(color), (size_t)4);
+				const CGFloat *components = CGColorGetComponents(color);
+				for (size_t index = 0; index < numberOfComponents; index++)
+				{
+					run.colorComponents[index] = components[index];
+				}
+			}
+			key = PINCHTextMeasurementHash(key, &run, sizeof(run));
+		}];
+	}
+	
+	struct {
+		CGFloat actualScaleFactor;
+		CGRect relativeClippingRect;
+		CGFloat scale;
+		BOOL underlined;
+	} drawing;
+	memset(&drawing, 0, sizeof(drawing));
+	drawing.actualScaleFactor = self.actualScaleFactor;
+	drawing.relativeClippingRect = PINCHClippingRectRelativeToRect(clippingRect, rect);
+	drawing.scale = scale;
+	drawing.underlined = self.underlined;
+	
+	return PINCHTextMeasurementHash(key, &drawing, sizeof(drawing));
+}
+
+/// Creates a result from a persisted measurement. The string is typeset once at the persisted scaleFactor for the
+/// geometry of the lines, without searching for the scale factor that fits
+- (PINCHTextLayoutResult *)layoutResultWithMeasurement:(PINCHTextMeasurement)measurement proposedRect:(CGRect)proposedRect containerRect:(CGRect)containerRect
+{
+	// Scales the attributedString before it is typeset and copied into the result
+	self.actualScaleFactor = measurement.scaleFactor;
+	
+	CGRect fitRect = UIEdgeInsetsInsetRect(proposedRect, self.textInsets);
+	PINCHTextLayoutTrial *trial = nil;
+	if (!CGRectIsEmpty(measurement.boundingRect) && fitRect.size.width > 0 && fitRect.size.height > 0)
+	{
+		trial = [self trialWithScaleFactor:measurement.scaleFactor fitRect:fitRect transform:[self typesettingTransformWithContainerRect:containerRect] frameAttributes:NULL clipped:NO];
+	}
+	
+	NSAttributedString *attributedString = nil;
+	NSData *linkRangeData = nil;
+	NSArray *linkValues = nil;
+	@synchronized(_attributedString)
+	{
+		attributedString = [_attributedString copy];
+		linkRangeData = _linkRangeData;
+		linkValues = _linkValues;
+	}
+	
+	BOOL truncated = [self truncateLastLineOfTrial:trial fitRect:fitRect clippingRect:CGRectZero attributedString:attributedString];
+	
+	CGRect boundingRect = (CGRectIsEmpty(measurement.boundingRect) ? CGRectZero : CGRectOffset(measurement.boundingRect, CGRectGetMinX(proposedRect), CGRectGetMinY(proposedRect)));
+	return [[PINCHTextLayoutResult alloc] initWithProposedRect:proposedRect clippingRect:CGRectZero boundingRect:boundingRect scaleFactor:measurement.scaleFactor numberOfLines:measurement.numberOfLines fitsProposedRect:measurement.fitsProposedRect truncated:truncated attributedString:attributedString lines:trial.lines lineData:trial.lineData drawingAttributes:[self drawingAttributes] linkRangeData:linkRangeData linkValues:linkValues];
+}
+
+#pragma mark - Layout cache
+
+/// The attributes the lines are drawn with as they are now, frozen into every layoutResult
+- (PINCHTextLayoutDrawingAttributes)drawingAttributes
+{
+	PINCHTextLayoutDrawingAttributes drawingAttributes;
+	memset(&drawingAttributes, 0, sizeof(drawingAttributes));
+	drawingAttributes.textInsets = self.textInsets;
+	drawingAttributes.textAlignment = self.textAlignment;
+	drawingAttributes.underlined = self.underlined;
+	drawingAttributes.breaksLastLine = self.breaksLastLine;
+	drawingAttributes.hyphenated = self.isHyphenated;
+	return drawingAttributes;
+}
+
+/// Sets the properties of the textLayout to the given results
+- (void)applyLayoutResult:(PINCHTextLayoutResult *)result
+{
+	self.actualScaleFactor = result.scaleFactor;
+	self.actualNumberOfLines = result.numberOfLines;
+	self.lineRects = nil;
+	self.stringFitsProposedRect = result.fitsProposedRect;
+	self.layoutResult = result;
+}
+
+- (NSArray *)lineRects
+{
+	// Boxed from the line geometry of the layoutResult when first used
+	return _lineRects ?: self.layoutResult.lineRects;
+}
+
+/// Only the size of the proposed rect and the position of the clippingRect relative to it influence the layout,
+/// so cached layouts can be reused when the proposed rect moves.
+- (PINCHTextLayoutResult *)cachedLayoutResultWithProposedRect:(CGRect)proposedRect clippingRect:(CGRect)clippingRect
+{
+	CGRect relativeClippingRect = PINCHClippingRectRelativeToRect(clippingRect, proposedRect);
+	
+	@synchronized(_layoutCache)
+	{
+		for (NSInteger index = [_layoutCache count] - 1; index >= 0; index--)
+		{
+			PINCHTextLayoutResult *cachedResult = _layoutCache[index];
+			CGRect cachedProposedRect = cachedResult.proposedRect;
+			CGRect cachedRelativeClippingRect = PINCHClippingRectRelativeToRect(cachedResult.clippingRect, cachedProposedRect);
+			
+			if (CGRectGetWidth(cachedProposedRect) != CGRectGetWidth(proposedRect) ||
+				!CGRectEqualToRect(cachedRelativeClippingRect, relativeClippingRect))
+			{
+				continue;
+			}
+			
+			// A different height gives the same result as long as the cached layout still fits in it,
+			// and when more height could not have resulted in a larger scale factor or more lines
+			CGFloat height = CGRectGetHeight(proposedRect);
+			CGFloat cachedHeight = CGRectGetHeight(cachedProposedRect);
+			BOOL heightMatches = (height == cachedHeight);
+			if (!heightMatches && height >= CGRectGetHeight(cachedResult.boundingRect))
+			{
+				BOOL fitsWithoutScaling = (cachedResult.fitsProposedRect && cachedResult.scaleFactor == 1.0f);
+				heightMatches = (height < cachedHeight || fitsWithoutScaling);
+			}
+			
+			if (heightMatches)
+			{
+				// Move to the end as most recently used
+				[_layoutCache removeObjectAtIndex:index];
+				[_layoutCache addObject:cachedResult];
+				return cachedResult;
+			}
+		}
+	}
+	return nil;
+}
+
+- (void)cacheLayoutResult:(PINCHTextLayoutResult *)result
+{
+	@synchronized(_layoutCache)
+	{
+		[_layoutCache addObject:result];
+		if ([_layoutCache count] > maximumNumberOfCachedLayouts)
+		{
+			[_layoutCache removeObjectAtIndex:0];
+		}
+	}
+}
+
+/// Returns the current layoutResult when it has been calculated for the given rect and clippingRect, moved to the origin of rect
+- (PINCHTextLayoutResult *)layoutResultForDrawingInRect:(CGRect)rect clippingRect:(CGRect)clippingRect
+{
+	PINCHTextLayoutResult *result = self.layoutResult;
+	
+	CGRect boundingRect = result.boundingRect;
+	if (result == nil || [result.lines count] == 0 || !CGSizeEqualToSize(boundingRect.size, rect.size) ||
+		result.scaleFactor != self.actualScaleFactor)
+	{
+		return nil;
+	}
+	
+	CGRect relativeClippingRect = PINCHClippingRectRelativeToRect(clippingRect, rect);
+	if (!CGRectEqualToRect(relativeClippingRect, PINCHClippingRectRelativeToRect(result.clippingRect, boundingRect)))
 	{
-		return _boundingRect;
+		return nil;
 	}
 	
-	_proposedRect = proposedRect;
-	_clippingRect = *clippingRect;
+	return [result layoutResultWithOffset:CGPointMake(CGRectGetMinX(rect) - CGRectGetMinX(boundingRect), CGRectGetMinY(rect) - CGRectGetMinY(boundingRect))];
+}
+
+/// Draws the underlines of all lines as segments, with gaps where the outlines of the glyphs cross the underline.
+/// Frames hold the text position and width of every line, in the flipped coordinates the lines were drawn in
+- (void)drawUnderlinesOfLines:(NSArray *)lines frames:(const CGRect *)frames inContext:(CGContextRef)context font:(UIFont *)font textColor:(UIColor *)textColor fixUnderlinePosition:(BOOL)fixUnderlinePosition
+{
+	CTFontRef ctFont = CTFontCreateWithName((CFStringRef)font.fontName, font.pointSize, NULL);
+	CGFloat underlinePosition = CTFontGetUnderlinePosition(ctFont);
+	CGFloat underlineThickness = fabs(CTFontGetUnderlineThickness(ctFont));
+	CFRelease(ctFont);
+	
+	if (fixUnderlinePosition)
+	{
+		// Since iOS 9, positions of underlines in Core Text are slightly shifted
+		// It appears the underlineThickness should be defined in the other direction
+		underlinePosition += underlineThickness;
+	}
 	
-	CGRect fitRect = UIEdgeInsetsInsetRect(proposedRect, textInsets);
+	// The band of the underline relative to the baseline, widened by the space kept around the glyphs
+	CGFloat gapPadding = floorf(font.pointSize / 8) / 2;
+	CGFloat bandMinY = -underlinePosition - (underlineThickness * 1.5) - gapPadding;
+	CGFloat bandMaxY = -underlinePosition + (underlineThickness * 0.5) + gapPadding;
 	
-	CGRect calculatedRect = CGRectZero;
+	NSMutableData *gapData = [NSMutableData data];
+	NSMutableData *segmentData = [NSMutableData data];
+	CTFontRef intervalsFont = NULL;
+	PINCHGlyphUnderlineIntervals *intervals = nil;
 	
-	if (fitRect.size.width > 0 && fitRect.size.height > 0)
+	NSUInteger numberOfLines = [lines count];
+	for (NSUInteger lineIndex = 0; lineIndex < numberOfLines; lineIndex++)
 	{
-		CFRange range;
+		CTLineRef line = (__bridge CTLineRef)lines[lineIndex];
+		CGPoint textPoint = frames[lineIndex].origin;
+		CGFloat lineWidth = CGRectGetWidth(frames[lineIndex]);
+		[gapData setLength:0];
 		
-		@synchronized(_attributedString)
+		CFArrayRef runs = CTLineGetGlyphRuns(line);
+		CFIndex numberOfRuns = CFArrayGetCount(runs);
+		for (CFIndex runIndex = 0; runIndex < numberOfRuns; runIndex++)
 		{
-			range = CFRangeMake(0, (CFIndex)_attributedString.length);
+			CTRunRef run = CFArrayGetValueAtIndex(runs, runIndex);
+			CFIndex glyphCount = CTRunGetGlyphCount(run);
+			CTFontRef runFont = CFDictionaryGetValue(CTRunGetAttributes(run), kCTFontAttributeName);
+			if (glyphCount == 0 || runFont == NULL)
+			{
+				continue;
+			}
+			
+			// Glyphs and positions are usually stored in the run, only copied when they aren't
+			const CGGlyph *glyphs = CTRunGetGlyphsPtr(run);
+			const CGPoint *positions = CTRunGetPositionsPtr(run);
+			CGGlyph *copiedGlyphs = NULL;
+			CGPoint *copiedPositions = NULL;
+			if (glyphs == NULL)
+			{
+				copiedGlyphs = malloc(sizeof(CGGlyph) * glyphCount);
+				CTRunGetGlyphs(run, CFRangeMake(0, 0), copiedGlyphs);
+				glyphs = copiedGlyphs;
+			}
+			if (positions == NULL)
+			{
+				copiedPositions = malloc(sizeof(CGPoint) * glyphCount);
+				CTRunGetPositions(run, CFRangeMake(0, 0), copiedPositions);
+				positions = copiedPositions;
+			}
+			
+			// Runs of a line, and usually all lines, share their font, so the cache is only searched when it changes
+			if (intervalsFont == NULL || !CFEqual(intervalsFont, runFont))
+			{
+				intervals = PINCHGlyphUnderlineIntervalsForFont(runFont, bandMinY, bandMaxY);
+				intervalsFont = runFont;
+			}
+			@synchronized(intervals)
+			{
+				for (CFIndex glyphIndex = 0; glyphIndex < glyphCount; glyphIndex++)
+				{
+					PINCHGlyphUnderlineInterval interval = PINCHGlyphUnderlineIntervalForGlyph(intervals, runFont, glyphs[glyphIndex], bandMinY, bandMaxY);
+					if (interval.intersects)
+					{
+						CGFloat glyphX = textPoint.x + positions[glyphIndex].x;
+						interval.minX = glyphX + interval.minX - gapPadding;
+						interval.maxX = glyphX + interval.maxX + gapPadding;
+						[gapData appendBytes:&interval length:sizeof(interval)];
+					}
+				}
+			}
+			
+			free(copiedGlyphs);
+			free(copiedPositions);
 		}
 		
-		if (range.length == 0)
+		// Walk the gaps from left to right and add the parts of the underline in between
+		PINCHGlyphUnderlineInterval *gaps = [gapData mutableBytes];
+		NSUInteger numberOfGaps = [gapData length] / sizeof(PINCHGlyphUnderlineInterval);
+		qsort(gaps, numberOfGaps, sizeof(PINCHGlyphUnderlineInterval), PINCHGlyphUnderlineIntervalCompare);
+		
+		CGFloat underlineY = textPoint.y - underlinePosition - (underlineThickness * 1.5);
+		CGFloat segmentStart = textPoint.x;
+		CGFloat lineEnd = textPoint.x + lineWidth;
+		for (NSUInteger gapIndex = 0; gapIndex <= numberOfGaps; gapIndex++)
 		{
-			return CGRectZero;
+			CGFloat segmentEnd = (gapIndex < numberOfGaps ? MIN(gaps[gapIndex].minX, lineEnd) : lineEnd);
+			if (segmentEnd > segmentStart)
+			{
+				CGRect segment = CGRectMake(segmentStart, underlineY, segmentEnd - segmentStart, underlineThickness * 2.0);
+				[segmentData appendBytes:&segment length:sizeof(segment)];
+			}
+			if (gapIndex < numberOfGaps)
+			{
+				segmentStart = MAX(segmentStart, gaps[gapIndex].maxX);
+			}
+		}
+	}
+	
+	NSUInteger numberOfSegments = [segmentData length] / sizeof(CGRect);
+	if (numberOfSegments == 0)
+	{
+		return;
+	}
+	
+	CGContextSaveGState(context);
+	{
+		// Don't draw a shadow with underlined text
+		CGContextSetShadowWithColor(context, CGSizeZero, 0.0, NULL);
+		CGContextSetFillColorWithColor(context, textColor.CGColor);
+		CGContextFillRects(context, [segmentData bytes], numberOfSegments);
+	}
+	CGContextRestoreGState(context);
+}
+
+/// Returns the line of lineRange with a hyphen in place of its trailing soft hyphen, justified when it is too wide or justified is set.
+/// Lines are reused from earlier draws as long as their range, available width and font size are the same
+- (CTLineRef)newHyphenatedLineAtIndex:(NSUInteger)lineIndex withRange:(NSRange)lineRange widthAvailable:(CGFloat)widthAvailable fontSize:(CGFloat)fontSize justified:(BOOL)justified attributedString:(NSAttributedString *)attributedString
+{
+	static const CGFloat justificationFactor = 1;
+	
+	PINCHTextLayoutSubstitutedLineKey key;
+	memset(&key, 0, sizeof(key));
+	key.range = lineRange;
+	key.widthAvailable = widthAvailable;
+	key.fontSize = fontSize;
+	key.justified = justified;
+	NSData *keyData = [NSData dataWithBytes:&key length:sizeof(key)];
+	
+	@synchronized(_substitutedLines)
+	{
+		NSDictionary *substitutedLine = _substitutedLines[@(lineIndex)];
+		if ([substitutedLine[@"Key"] isEqualToData:keyData])
+		{
+			return (CTLineRef)CFRetain((__bridge CTLineRef)substitutedLine[@"Line"]);
+		}
+	}
+	
+	NSMutableAttributedString *lineAttrString = [[attributedString attributedSubstringFromRange:lineRange] mutableCopy];
+	NSRange replaceRange = NSMakeRange(lineRange.length-1, 1);
+	[lineAttrString replaceCharactersInRange:replaceRange withString:@"-"];
+	
+	CTLineRef line = CTLineCreateWithAttributedString((__bridge CFAttributedStringRef)lineAttrString);
+	
+	// get the metrics when hyphenated
+	CGFloat lineWidth = CTLineGetTypographicBounds(line, NULL, NULL, NULL);
+	if (lineWidth > widthAvailable || justified)
+	{
+		CTLineRef justifiedLine = CTLineCreateJustifiedLine(line, justificationFactor, widthAvailable);
+		if (justifiedLine != NULL)
+		{
+			CFRelease(line);
+			line = justifiedLine;
 		}
+	}
+	
+	@synchronized(_substitutedLines)
+	{
+		_substitutedLines[@(lineIndex)] = @{@"Key": keyData, @"Line": (__bridge id)line};
+	}
+	return line;
+}
+
+/// Returns a line with an ellipsis in place of line when the string continues after it, or NULL when it doesn't
+- (CTLineRef)newTruncatedLineWithLine:(CTLineRef)line lineRect:(CGRect)lineRect fitRect:(CGRect)fitRect clippingRect:(CGRect)clippingRect attributedString:(NSAttributedString *)attributedString
+{
+	CFRange lineRange = CTLineGetStringRange(line);
+	CFIndex length = (CFIndex)[attributedString length];
+	if (lineRange.location + lineRange.length >= length)
+	{
+		return NULL;
+	}
+	
+	CGFloat widthAvailable = CGRectGetWidth(fitRect) - self.lastLineInset;
+	
+	// Use the full width of the line to calculate clipping
+	CGRect fullLineRect = lineRect;
+	fullLineRect.origin.x = CGRectGetMinX(fitRect);
+	fullLineRect.size.width = CGRectGetWidth(fitRect);
+	if (!CGRectIsEmpty(clippingRect) && CGRectIntersectsRect(fullLineRect, clippingRect))
+	{
+		widthAvailable -= CGRectGetWidth(CGRectIntersection(fullLineRect, clippingRect));
+	}
+	
+	// The ellipsis replaces the end of the line, and looks like the text there with its kerning, paragraph style and color
+	NSUInteger truncationLocation = lineRange.location + MAX(lineRange.length, 1) - 1;
+	CTLineRef truncationToken = PINCHTruncationTokenCreateWithAttributes([attributedString attributesAtIndex:truncationLocation effectiveRange:NULL]);
+	
+	// Only a window from the start of the line is typeset, grown until it is wider than the available width,
+	// so the cost doesn't depend on the length of the rest of the string
+	NSString *string = attributedString.string;
+	CFIndex windowLength = MAX(lineRange.length * 2, minimumTruncationWindowLength);
+	CTLineRef longLine = NULL;
+	while (YES)
+	{
+		NSRange windowRange = NSMakeRange(lineRange.location, MIN(windowLength, length - lineRange.location));
+		windowRange = [string rangeOfComposedCharacterSequencesForRange:windowRange];
+		CFAttributedStringRef longString = CFAttributedStringCreateWithSubstring(NULL, (CFAttributedStringRef)attributedString, CFRangeMake(windowRange.location, windowRange.length));
+		longLine = CTLineCreateWithAttributedString(longString);
+		CFRelease(longString);
 		
-		__block CFRange fitRange = CFRangeMake(0, 0);
+		if ((CFIndex)NSMaxRange(windowRange) >= length || CTLineGetTypographicBounds(longLine, NULL, NULL, NULL) > widthAvailable)
+		{
+			break;
+		}
+		CFRelease(longLine);
+		windowLength *= 2;
+	}
+	
+	CTLineRef truncatedLine = CTLineCreateTruncatedLine(longLine, widthAvailable, kCTLineTruncationEnd, truncationToken);
+	CFRelease(longLine);
+	CFRelease(truncationToken);
+	
+	return truncatedLine;
+}
+
+/// Flips the lines of a frame typeset in containerRect to the coordinates of UIKit, leaving room for the textInsets
+- (CGAffineTransform)typesettingTransformWithContainerRect:(CGRect)containerRect
+{
+	UIEdgeInsets textInsets = self.textInsets;
+	CGAffineTransform transform = CGAffineTransformMakeScale(1.0f, -1.0f);
+	return CGAffineTransformTranslate(transform, 0, -(CGRectGetHeight(containerRect) - textInsets.top + textInsets.bottom));
+}
+
+/// Replaces the last line of trial with a truncated line when the string doesn't fit, so drawing can use it as is.
+/// Returns whether the line has been truncated
+- (BOOL)truncateLastLineOfTrial:(PINCHTextLayoutTrial *)trial fitRect:(CGRect)fitRect clippingRect:(CGRect)clippingRect attributedString:(NSAttributedString *)attributedString
+{
+	NSArray *lines = trial.lines;
+	NSData *lineData = trial.lineData;
+	NSInteger lastLineIndex = trial.lastLineIndex;
+	if (!self.breaksLastLine || lastLineIndex < 0 || lastLineIndex >= (NSInteger)[lines count])
+	{
+		return NO;
+	}
+	
+	const PINCHTextLayoutLine *layoutLines = [lineData bytes];
+	CTLineRef truncatedLine = [self newTruncatedLineWithLine:(__bridge CTLineRef)lines[lastLineIndex] lineRect:layoutLines[lastLineIndex].rect fitRect:fitRect clippingRect:clippingRect attributedString:attributedString];
+	if (truncatedLine == NULL)
+	{
+		return NO;
+	}
+	
+	NSMutableData *truncatedLineData = [lineData mutableCopy];
+	PINCHTextLayoutLine *lastLine = (PINCHTextLayoutLine *)[truncatedLineData mutableBytes] + lastLineIndex;
+	lastLine->trailingWhitespaceWidth = CTLineGetTrailingWhitespaceWidth(truncatedLine);
+	lastLine->rect.size.width = CGRectGetWidth(CTLineGetBoundsWithOptions(truncatedLine, 0)) - lastLine->trailingWhitespaceWidth;
+	
+	NSMutableArray *truncatedLines = [lines mutableCopy];
+	truncatedLines[lastLineIndex] = (__bridge_transfer id)truncatedLine;
+	
+	trial.lines = truncatedLines;
+	trial.lineData = truncatedLineData;
+	return YES;
+}
+
+/// Typesets the string at the given scale factor, returns the size, the lines and their geometry,
+/// number of lines, the index of the last line in the size and whether the string got capped
+- (PINCHTextLayoutTrial *)trialWithScaleFactor:(CGFloat)scaleFactor fitRect:(CGRect)fitRect transform:(CGAffineTransform)transform frameAttributes:(CFDictionaryRef)frameAttributes clipped:(BOOL)clipped
+{
+	CTFramesetterRef framesetter = (CTFramesetterRef)CFRetain([self framesetterWithScaleFactor:scaleFactor]);
+	
+	NSString *string = nil;
+	NSParagraphStyle *paragraphStyle = nil;
+	UIFont *font = nil;
+	@synchronized(_attributedString)
+	{
+		string = [_attributedString.string copy];
+		paragraphStyle = [_attributedString attribute:NSParagraphStyleAttributeName atIndex:0 effectiveRange:NULL];
+		font = [_attributedString attribute:NSFontAttributeName atIndex:0 effectiveRange:NULL];
+	}
+	
+	CFRange range = CFRangeMake(0, (CFIndex)[string length]);
+	CFRange fitRange = CFRangeMake(0, 0);
+	
+	CGFloat lineHeight = paragraphStyle.maximumLineHeight;
+	if (scaleFactor != self.actualScaleFactor)
+	{
+		// Font and lineHeight at the given scale factor, which isn't applied to the attributedString
+		font = [UIFont fontWithName:font.fontName size:roundf(_initialFontSize * scaleFactor)];
+		lineHeight = roundf(_initialLineHeight * scaleFactor);
+	}
+	CGFloat descender = roundf(font.descender);
+	
+	NSUInteger numberOfLinesToDraw = 0;
+	CFIndex lastDrawnLineIndex = -1;
+	CGSize size = CGSizeZero;
+	
+	// Whether string is fits in the given rect
+	BOOL cappedString = NO;
+	
+	CFIndex maximumNumberOfLines = (CFIndex)self.maximumNumberOfLines;
+	
+	// Without clipping every line spans the width of the rect, so one line more than the maximum is enough to know
+	// the string gets capped. Clipped lines can be split in two by the clippingRect and need the whole string
+	CFRange frameRange = range;
+	if (maximumNumberOfLines > 0 && !clipped)
+	{
+		frameRange.length = PINCHFramesetterGetLengthOfLines(framesetter, maximumNumberOfLines + 1, CGRectGetWidth(fitRect), range.length);
+	}
+	
+	CGPathRef framePath = CGPathCreateWithRect(fitRect, &transform);
+	CTFrameRef frame = CTFramesetterCreateFrame(framesetter, frameRange, framePath, frameAttributes);
+	CGRect frameBounds = CGPathGetPathBoundingBox(framePath);
+	
+	CFArrayRef lines = CTFrameGetLines(frame);
+	CGPoint *origins = malloc(sizeof(CGPoint) * CFArrayGetCount(lines));
+	CTFrameGetLineOrigins(frame, CFRangeMake(0, 0), origins);
+	
+	CFIndex numberOfLines = CFArrayGetCount(lines);
+	CGFloat maxWidth = 0;
+	
+	// Geometry of all lines in a single buffer
+	NSMutableData *lineData = [NSMutableData dataWithLength:sizeof(PINCHTextLayoutLine) * numberOfLines];
+	PINCHTextLayoutLine *layoutLines = [lineData mutableBytes];
+	
+	if (numberOfLines > 0)
+	{
+		CFIndex lastLineIndex = MAX(numberOfLines - 1, 0);
+		CGFloat lastLineOffset = origins[lastLineIndex].y;
 		
-		CFDictionaryRef frameAttributes = NULL;
+		CGFloat distanceFromTop = CGRectGetMaxY(frameBounds) - (lastLineOffset + descender) - CGRectGetMinY(frameBounds);
+		CFIndex actualNumberOfLines = round(distanceFromTop / lineHeight);
 		
-		CGAffineTransform transform = CGAffineTransformMakeScale(1.0f, -1.0f);
-		transform = CGAffineTransformTranslate(transform, 0, -(CGRectGetHeight(containerRect) - textInsets.top + textInsets.bottom));
+		CFIndex globalLastLineIndex = lastLineIndex;
 		
-		if (!CGRectIsEmpty(_clippingRect))
+		if (maximumNumberOfLines > 0 && numberOfLines > maximumNumberOfLines)
 		{
-			if (frameAttributes != NULL)
+			if (actualNumberOfLines > maximumNumberOfLines)
 			{
-				CFRelease(frameAttributes);
+				cappedString = YES;
+			}
+			
+			if (clipped)
+			{
+				// Two (or more) lines exist when lines are clipped in the middle
+				// Search actual last line
+				CGFloat actualLastLineOffest = CGRectGetMinY(frameBounds) + (lineHeight * maximumNumberOfLines);
+				CGFloat halfLineHeight = round(lineHeight / 2.0f);
+				actualLastLineOffest = roundf(actualLastLineOffest / halfLineHeight) * halfLineHeight;
+				for (CFIndex lineIndex = actualNumberOfLines - 1; lineIndex >= 0; lineIndex --)
+				{
+					CGFloat searchLineOriginY = roundf(origins[lineIndex].y / halfLineHeight) * halfLineHeight;
+					if (searchLineOriginY == actualLastLineOffest)
+					{
+						lastLineIndex = lineIndex;
+						break;
+					}
+				}
 			}
-			frameAttributes = PINCHFrameAttributesCreateWithClippingRect(_clippingRect, transform);
+			else
+			{
+				lastLineIndex = MIN(numberOfLines, maximumNumberOfLines) - 1;
+			}
+			
+			globalLastLineIndex = MIN(lastLineIndex, maximumNumberOfLines - 1);
 		}
 		
-		CGSize size = CGSizeZero;
+		numberOfLinesToDraw = globalLastLineIndex + 1;
 		
-		BOOL shouldStopIteration = NO;
-		self.actualScaleFactor = 1.0;
+		CTLineRef lastLine = NULL;
 		
-		NSInteger iteration = 0;
-		
-		NSMutableArray *lineRects = [@[] mutableCopy];
-		
-		while (shouldStopIteration == NO)
+		for (CFIndex lineIndex = 0; lineIndex < numberOfLines; lineIndex ++)
 		{
-			// Iterate while text doesn't fit proposed rect and minimumScaleFactor is set
-			[lineRects removeAllObjects];
-			
-			iteration++;
-			
-			CTFramesetterRef framesetter = self.framesetter;
-			
-			NSParagraphStyle *paragraphStyle;
-			UIFont *font;
-			NSString *string = nil;
-			@synchronized(_attributedString)
+			CTLineRef line = CFArrayGetValueAtIndex(lines, lineIndex);
+			if (lineIndex == lastLineIndex)
 			{
-				string = _attributedString.string;
-				if (_attributedString.length > 0)
-				{
-					paragraphStyle = [_attributedString attribute:NSParagraphStyleAttributeName atIndex:0 effectiveRange:NULL];
-					font = [_attributedString attribute:NSFontAttributeName atIndex:0 effectiveRange:NULL];
-				}
+				lastLine = line;
 			}
 			
-			CGFloat descender = roundf(font.descender);
-			CGFloat lineHeight = self.lineHeight;
-			
-			// Whether string is fits in the given rect
-			BOOL cappedString = NO;
-			
-			CFIndex maximumNumberOfLines = (CFIndex)self.maximumNumberOfLines;
-			
-			CGPathRef framePath = CGPathCreateWithRect(fitRect, &transform);
-			CTFrameRef frame = CTFramesetterCreateFrame(framesetter, range, framePath, frameAttributes);
-			CGRect frameBounds = CGPathGetPathBoundingBox(framePath);
-			
-			CFArrayRef lines = CTFrameGetLines(frame);
-			CGPoint *origins = malloc(sizeof(CGPoint) * CFArrayGetCount(lines));
-			CTFrameGetLineOrigins(frame, CFRangeMake(0, 0), origins);
-			
-			CFIndex numberOfLines = CFArrayGetCount(lines);
-			CGFloat maxWidth = 0;
-			
-			if (numberOfLines > 0)
+			// Check if last character isn't whitespace
+			CFRange lineRange = CTLineGetStringRange(line);
+			if (self.prefersNonWrappedWords && lineRange.length > 2)
 			{
-				CFIndex lastLineIndex = MAX(numberOfLines - 1, 0);
-				CGFloat lastLineOffset = origins[lastLineIndex].y;
-				
-				CGFloat distanceFromTop = CGRectGetMaxY(frameBounds) - (lastLineOffset + descender) - CGRectGetMinY(frameBounds);
-				CFIndex actualNumberOfLines = round(distanceFromTop / lineHeight);
-				
-				CFIndex globalLastLineIndex = lastLineIndex;
-				
-				if (maximumNumberOfLines > 0 && numberOfLines > maximumNumberOfLines)
+				NSRange lastCharacterRange = NSMakeRange(lineRange.location + lineRange.length - 1, 1);
+				if (NSMaxRange(lastCharacterRange) != [string length])
 				{
-					if (actualNumberOfLines > maximumNumberOfLines)
+					NSString *lastCharacter = [string substringWithRange:lastCharacterRange];
+					NSCharacterSet *characterSet = [NSCharacterSet characterSetWithCharactersInString:[NSString stringWithFormat:@"\n\r\t- %C", (unichar)0x00AD]];
+					NSRange whiteSpaceRange = [lastCharacter rangeOfCharacterFromSet:characterSet];
+					if (whiteSpaceRange.location == NSNotFound )
 					{
+						
 						cappedString = YES;
 					}
-					
-					if (!CGRectIsEmpty(*clippingRect))
-					{
-						// Two (or more) lines exist when lines are clipped in the middle
-						// Search actual last line
-						CGFloat actualLastLineOffest = CGRectGetMinY(frameBounds) + (lineHeight * maximumNumberOfLines);
-						CGFloat halfLineHeight = round(lineHeight / 2.0f);
-						actualLastLineOffest = roundf(actualLastLineOffest / halfLineHeight) * halfLineHeight;
-						for (CFIndex lineIndex = actualNumberOfLines - 1; lineIndex >= 0; lineIndex --)
-						{
-							CGFloat searchLineOriginY = roundf(origins[lineIndex].y / halfLineHeight) * halfLineHeight;
-							if (searchLineOriginY == actualLastLineOffest)
-							{
-								lastLineIndex = lineIndex;
-								break;
-							}
-						}
-					}
-					else
-					{
-						lastLineIndex = MIN(numberOfLines, maximumNumberOfLines) - 1;
-					}
-					
-					globalLastLineIndex = MIN(lastLineIndex, maximumNumberOfLines - 1);
-				}
-				
-				
-				self.actualNumberOfLines = globalLastLineIndex + 1;
-				
-				CTLineRef lastLine = NULL;
-				
-				for (CFIndex lineIndex = 0; lineIndex < numberOfLines; lineIndex ++)
-				{
-					CTLineRef line = CFArrayGetValueAtIndex(lines, lineIndex);
-					if (lineIndex == lastLineIndex)
-					{
-						lastLine = line;
-					}
-					
-					// Check if last character isn't whitespace
-					CFRange lineRange = CTLineGetStringRange(line);
-					if (self.prefersNonWrappedWords && lineRange.length > 2)
-					{
-						NSRange lastCharacterRange = NSMakeRange(lineRange.location + lineRange.length - 1, 1);
-						if (NSMaxRange(lastCharacterRange) != [string length])
-						{
-							NSString *lastCharacter = [string substringWithRange:lastCharacterRange];
-							NSCharacterSet *characterSet = [NSCharacterSet characterSetWithCharactersInString:[NSString stringWithFormat:@"\n\r\t- %C", (unichar)0x00AD]];
-							NSRange whiteSpaceRange = [lastCharacter rangeOfCharacterFromSet:characterSet];
-							if (whiteSpaceRange.location == NSNotFound )
-							{
-								
-								cappedString = YES;
-							}
-						}
-					}
-					
-					// Calculate the correct linebounds
-					CGRect lineRect = CTLineGetBoundsWithOptions(line, 0);
-					lineRect.size.height = lineHeight;
-					lineRect.size.width -= CTLineGetTrailingWhitespaceWidth(line);
-					
-					CGPoint lineOrigin = origins[lineIndex];
-					lineOrigin.x += CGRectGetMinX(frameBounds);
-					lineOrigin.y += CGRectGetMinY(frameBounds) + descender;
-					lineOrigin.y = ceilf(CGRectGetMaxY(frameBounds) - lineOrigin.y) + CGRectGetMinY(fitRect) - CGRectGetHeight(lineRect);
-					lineRect.origin = lineOrigin;
-					
-					CGFloat currentWidth;
-					// Actual width is measured by max distance from framebounds (clipping full lines moves them)
-					if (paragraphStyle.alignment == NSTextAlignmentRight)
-					{
-						currentWidth = CGRectGetMaxX(frameBounds) - CGRectGetMinX(lineRect);
-					}
-					else
-					{
-						currentWidth = CGRectGetMaxX(lineRect) - CGRectGetMinX(frameBounds);
-					}
-					
-					maxWidth = fmaxf(maxWidth, currentWidth);
-					
-					[lineRects addObject:[NSValue valueWithCGRect:lineRect]];
 				}
-				
-				CGPoint lastLineOrigin = origins[(int)lastLineIndex];
-				lastLineOrigin.x += CGRectGetMinX(frameBounds);
-				lastLineOrigin.y += CGRectGetMinY(frameBounds) + roundf(font.descender);
-				
-				CFRange lineRange = CTLineGetStringRange(lastLine);
-				fitRange.length = lineRange.location + lineRange.length;
-				
-				size.width = ceilf(fminf(maxWidth, CGRectGetWidth(fitRect)));
-				size.height = ceilf(CGRectGetMaxY(frameBounds) - lastLineOrigin.y);
 			}
 			
-			free(origins);
-			CFRelease(frame);
-			CGPathRelease(framePath);
+			// Calculate the correct linebounds
+			CGRect lineRect = CTLineGetBoundsWithOptions(line, 0);
+			CGFloat trailingWhitespaceWidth = CTLineGetTrailingWhitespaceWidth(line);
+			lineRect.size.height = lineHeight;
+			lineRect.size.width -= trailingWhitespaceWidth;
 			
-			if (!cappedString)
-			{
-				cappedString = (fitRange.length < range.length);
-			}
+			CGPoint lineOrigin = origins[lineIndex];
+			lineOrigin.x += CGRectGetMinX(frameBounds);
+			lineOrigin.y += CGRectGetMinY(frameBounds) + descender;
+			lineOrigin.y = ceilf(CGRectGetMaxY(frameBounds) - lineOrigin.y) + CGRectGetMinY(fitRect) - CGRectGetHeight(lineRect);
+			lineRect.origin = lineOrigin;
 			
-			if (!cappedString || self.minimumScaleFactor == 0)
+			CGFloat currentWidth;
+			// Actual width is measured by max distance from framebounds (clipping full lines moves them)
+			if (paragraphStyle.alignment == NSTextAlignmentRight)
 			{
-				self.stringFitsProposedRect = !cappedString;
-				shouldStopIteration = YES;
+				currentWidth = CGRectGetMaxX(frameBounds) - CGRectGetMinX(lineRect);
 			}
 			else
 			{
-				size = [self handleBoundsCalculationIterationWithSize:size cappedString:cappedString shouldStop:&shouldStopIteration];
+				currentWidth = CGRectGetMaxX(lineRect) - CGRectGetMinX(frameBounds);
 			}
+			
+			maxWidth = fmaxf(maxWidth, currentWidth);
+			
+			// Baseline of the line in the coordinates of the proposed rect, used for drawing the lines later on
+			CGPoint baselineOrigin = CGPointMake(origins[lineIndex].x + CGRectGetMinX(frameBounds), origins[lineIndex].y + CGRectGetMinY(frameBounds));
+			
+			layoutLines[lineIndex].rect = lineRect;
+			layoutLines[lineIndex].origin = CGPointApplyAffineTransform(baselineOrigin, transform);
+			layoutLines[lineIndex].range = NSMakeRange(lineRange.location, lineRange.length);
+			layoutLines[lineIndex].trailingWhitespaceWidth = trailingWhitespaceWidth;
 		}
 		
-		self.lineRects = lineRects;
+		CGPoint lastLineOrigin = origins[(int)lastLineIndex];
+		lastLineOrigin.x += CGRectGetMinX(frameBounds);
+		lastLineOrigin.y += CGRectGetMinY(frameBounds) + descender;
 		
-		if (frameAttributes != NULL)
-		{
-			CFRelease(frameAttributes);
-		}
-		
-		calculatedRect.size = size;
-		calculatedRect.origin = fitRect.origin;
+		CFRange lineRange = CTLineGetStringRange(lastLine);
+		fitRange.length = lineRange.location + lineRange.length;
+		lastDrawnLineIndex = lastLineIndex;
 		
-		if (size.width < CGRectGetWidth(fitRect))
-		{
-			if (_textAlignment == NSTextAlignmentRight)
-			{
-				calculatedRect.origin.x += CGRectGetWidth(fitRect) - size.width;
-			}
-			else if (_textAlignment == NSTextAlignmentCenter)
-			{
-				calculatedRect.origin.x = roundf(CGRectGetMidX(fitRect) - (size.width / 2));
-			}
-		}
+		size.width = ceilf(fminf(maxWidth, CGRectGetWidth(fitRect)));
+		size.height = ceilf(CGRectGetMaxY(frameBounds) - lastLineOrigin.y);
 	}
 	
-	if (!CGRectIsEmpty(calculatedRect))
+	// Keep the typeset lines, they outlive the frame
+	NSArray *typesetLines = [(__bridge NSArray *)lines copy];
+	
+	free(origins);
+	CFRelease(frame);
+	CGPathRelease(framePath);
+	CFRelease(framesetter);
+	
+	if (!cappedString)
 	{
-		calculatedRect = UIEdgeInsetsInsetRect(calculatedRect, PINCHEdgeInsetsInvert(self.textInsets));
+		cappedString = (fitRange.length < range.length);
 	}
 	
-	_boundingRect = calculatedRect;
-	return _boundingRect;
+	PINCHTextLayoutTrial *trial = [[PINCHTextLayoutTrial alloc] init];
+	trial.size = size;
+	trial.lineData = lineData;
+	trial.lines = typesetLines;
+	trial.numberOfLines = numberOfLinesToDraw;
+	trial.lastLineIndex = lastDrawnLineIndex;
+	trial.cappedString = cappedString;
+	return trial;
 }
 
 - (void)drawInContext:(CGContextRef)context withRect:(CGRect)rect
@@ -959,6 +2151,28 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 }
 
 - (void)drawInContext:(CGContextRef)context withRect:(CGRect)rect clippingRect:(CGRect)clippingRect
+{
+	PINCHTextLayoutResult *layoutResult = [self layoutResultForDrawingInRect:rect clippingRect:clippingRect];
+	if (layoutResult)
+	{
+		[self drawLayoutResult:layoutResult inContext:context];
+		return;
+	}
+	
+	@synchronized(self)
+	{
+		[self drawInContext:context withRect:rect clippingRect:clippingRect layoutResult:nil];
+	}
+}
+
+- (void)drawLayoutResult:(PINCHTextLayoutResult *)layoutResult inContext:(CGContextRef)context
+{
+	[self drawInContext:context withRect:layoutResult.boundingRect clippingRect:layoutResult.clippingRect layoutResult:layoutResult];
+}
+
+/// Draws the lines of layoutResult when given, with the attributes and links frozen in it instead of the mutable state of the textLayout.
+/// Otherwise the attributedString is typeset in rect, which requires the caller to lock the textLayout.
+- (void)drawInContext:(CGContextRef)context withRect:(CGRect)rect clippingRect:(CGRect)clippingRect layoutResult:(PINCHTextLayoutResult *)layoutResult
 {
 	if (CGRectIsEmpty(rect))
 	{
@@ -972,330 +2186,284 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 		return;
 	}
 	
-	CGFloat scale = [[UIScreen mainScreen] scale];
-	
-	@synchronized(self)
+	NSAttributedString *attributedString = (layoutResult ? layoutResult.attributedString : self.attributedString);
+	if (attributedString.length == 0)
 	{
-		if (self.attributedString.length == 0)
+		if (layoutResult == nil)
 		{
 			self.stringFitsProposedRect = YES;
-			return;
 		}
+		return;
+	}
+	
+	// Only notified of the drawing, the textRenderer is read once
+	PINCHTextRenderer *textRenderer = self.textRenderer;
+	[textRenderer textLayoutWillRender:self inRect:rect withContext:context];
+	
+	CFRange range = CFRangeMake(0, (CFIndex)attributedString.length);
+	
+	PINCHTextLayoutDrawingAttributes drawingAttributes;
+	NSData *linkRangeData = nil;
+	NSArray *linkValues = nil;
+	if (layoutResult)
+	{
+		drawingAttributes = layoutResult.drawingAttributes;
+		linkRangeData = layoutResult.linkRangeData;
+		linkValues = layoutResult.linkValues;
+	}
+	else
+	{
+		drawingAttributes = [self drawingAttributes];
+		@synchronized(_attributedString)
+		{
+			linkRangeData = _linkRangeData;
+			linkValues = _linkValues;
+		}
+	}
+	const PINCHTextLayoutLinkRange *linkRanges = [linkRangeData bytes];
+	NSUInteger numberOfLinkRanges = [linkValues count];
+	BOOL checkForURLs = (numberOfLinkRanges > 0 && [textRenderer textLayoutShouldCheckForURLS:self]);
+	BOOL fixUnderlinePosition = false;
+	if ([[NSProcessInfo processInfo] respondsToSelector:@selector(operatingSystemVersion)] &&
+		[NSProcessInfo processInfo].operatingSystemVersion.majorVersion >= 9)
+	{
+		fixUnderlinePosition = true;
+	}
+	
+	// Save the context state bofore the transforms
+	CGContextSaveGState(context);
+	{
+		CGContextSetTextMatrix(context, CGAffineTransformIdentity);
+		UIColor *textColor = [attributedString attribute:NSForegroundColorAttributeName atIndex:0 effectiveRange:NULL];
+		CGContextSetFillColorWithColor(context, textColor.CGColor);
+		CGAffineTransform transform = CGAffineTransformMakeScale(1.0f, -1.0f);
+		transform = CGAffineTransformTranslate(transform, 0, -(CGRectGetHeight(bounds)));
+		CGContextConcatCTM(context, transform);
 		
-		[self.textRenderer textLayoutWillRender:self inRect:rect withContext:context];
+		NSParagraphStyle *paragraphStyle = [attributedString attribute:NSParagraphStyleAttributeName atIndex:0 effectiveRange:NULL];
+		UIFont *font = [attributedString attribute:NSFontAttributeName atIndex:0 effectiveRange:NULL];
 		
-		CTFramesetterRef framesetter = self.framesetter;
-		CFRange range = CFRangeMake(0, (CFIndex)self.attributedString.length);
+		CGFloat descender = roundf(font.descender);
+		CGFloat lineHeight = paragraphStyle.maximumLineHeight;
 		
-		BOOL checkForURLs = [self.textRenderer textLayoutShouldCheckForURLS:self];
-		BOOL fixUnderlinePosition = false;
-		if ([[NSProcessInfo processInfo] respondsToSelector:@selector(operatingSystemVersion)] &&
-			[NSProcessInfo processInfo].operatingSystemVersion.majorVersion >= 9)
-		{
-			fixUnderlinePosition = true;
-		}
+		CGRect fitRect = UIEdgeInsetsInsetRect(rect, drawingAttributes.textInsets);
+		CGPathRef framePath = CGPathCreateWithRect(fitRect, &transform);
+		CGRect frameBounds = CGPathGetPathBoundingBox(framePath);
+		CTFrameRef frame = NULL;
+		CFArrayRef lines = NULL;
+		CGPoint *origins = NULL;
+		CFIndex numberOfLines = 0;
 		
-		// Save the context state bofore the transforms
-		CGContextSaveGState(context);
+		if (layoutResult)
 		{
-			CGContextSetTextMatrix(context, CGAffineTransformIdentity);
-			UIColor *textColor = [self.attributedString attribute:NSForegroundColorAttributeName atIndex:0 effectiveRange:NULL];
-			CGContextSetFillColorWithColor(context, textColor.CGColor);
-			CGAffineTransform transform = CGAffineTransformMakeScale(1.0f, -1.0f);
-			transform = CGAffineTransformTranslate(transform, 0, -(CGRectGetHeight(bounds)));
-			CGContextConcatCTM(context, transform);
+			// Draw the lines of the measurement in this rect, so the string doesn't need to be typeset again
+			NSArray *layoutLines = layoutResult.lines;
+			const PINCHTextLayoutLine *lineGeometry = NULL;
+			PINCHTextLayoutResultGetLines(layoutResult, &lineGeometry);
 			
-			NSParagraphStyle *paragraphStyle = [self.attributedString attribute:NSParagraphStyleAttributeName atIndex:0 effectiveRange:NULL];
-			UIFont *font = [self.attributedString attribute:NSFontAttributeName atIndex:0 effectiveRange:NULL];
-			
-			CGFloat descender = roundf(font.descender);
-			CGFloat lineHeight = paragraphStyle.maximumLineHeight;
-			
-			CGPathRef framePath = CGPathCreateWithRect(UIEdgeInsetsInsetRect(rect, self.textInsets), &transform);
+			CFMutableArrayRef drawnLines = CFArrayCreateMutable(NULL, (CFIndex)[layoutLines count], &kCFTypeArrayCallBacks);
+			origins = malloc(sizeof(CGPoint) * MAX([layoutLines count], 1));
+			for (NSUInteger lineIndex = 0; lineIndex < [layoutLines count]; lineIndex ++)
+			{
+				// Only lines which fit in the rect would have been part of a frame typeset in it
+				if (CGRectGetMaxY(lineGeometry[lineIndex].rect) > CGRectGetMaxY(fitRect) + 0.5f)
+				{
+					continue;
+				}
+				CFArrayAppendValue(drawnLines, (__bridge CTLineRef)layoutLines[lineIndex]);
+				origins[numberOfLines] = CGPointApplyAffineTransform(lineGeometry[lineIndex].origin, transform);
+				numberOfLines ++;
+			}
+			lines = drawnLines;
+		}
+		else
+		{
 			CFDictionaryRef frameAttributes = PINCHFrameAttributesCreateWithClippingRect(clippingRect, transform);
-			CTFrameRef frame = CTFramesetterCreateFrame(framesetter, range, framePath, frameAttributes);
+			frame = CTFramesetterCreateFrame(self.framesetter, range, framePath, frameAttributes);
 			CFRelease(frameAttributes);
 			
-			// Draw each line individually
-			CFArrayRef lines = CTFrameGetLines(frame);
-			CGPoint *origins = malloc(sizeof(CGPoint) * CFArrayGetCount(lines));
+			lines = (CFArrayRef)CFRetain(CTFrameGetLines(frame));
+			numberOfLines = CFArrayGetCount(lines);
+			origins = malloc(sizeof(CGPoint) * MAX(numberOfLines, 1));
 			CTFrameGetLineOrigins(frame, CFRangeMake(0, 0), origins);
+			for (CFIndex lineIndex = 0; lineIndex < numberOfLines; lineIndex ++)
+			{
+				origins[lineIndex].x += CGRectGetMinX(frameBounds);
+				origins[lineIndex].y += CGRectGetMinY(frameBounds);
+			}
+		}
+		
+		CGRect transformedClippingRect = (CGRectIsEmpty(clippingRect) ? clippingRect : CGRectApplyAffineTransform(clippingRect, transform));
+		
+		// References for special lines
+		CTLineRef truncatedLine = NULL;
+		CTLineRef substitutedLine = NULL;
+		
+		// Lines with their text position and width, underlined once all lines have been drawn
+		NSMutableArray *underlinedLines = (drawingAttributes.underlined ? [NSMutableArray array] : nil);
+		NSMutableData *underlinedLineFrames = (drawingAttributes.underlined ? [NSMutableData data] : nil);
+		
+		// Draw each line individually
+		for (CFIndex lineIndex = 0; lineIndex < numberOfLines; lineIndex ++)
+		{
+			CTLineRef line = CFArrayGetValueAtIndex(lines, lineIndex);
+			CGPoint origin = origins[lineIndex];
 			
-			CGRect frameBounds = CGPathGetPathBoundingBox(framePath);
-			CGRect transformedClippingRect = (CGRectIsEmpty(clippingRect) ? clippingRect : CGRectApplyAffineTransform(clippingRect, transform));
+			CGContextSetTextPosition(context, origin.x, origin.y);
+			CGRect lineBounds = CTLineGetBoundsWithOptions(line, 0);
 			
-			// References for special lines
-			CTLineRef truncatedLine = NULL;
-			CTLineRef hyphenatedLine = NULL;
-			CTLineRef justifiedLine = NULL;
+			CGPoint lineBoundsOrigin = CGContextGetTextPosition(context);
+			lineBoundsOrigin.y += descender;
+			lineBounds.size.height = lineHeight;
+			lineBounds.origin = lineBoundsOrigin;
 			
-			CTFontRef ctFont = NULL;
+			// Use fullLineBounds to calculate clipping
+			CGRect fullLineBounds = lineBounds;
+			fullLineBounds.size.width = CGRectGetWidth(frameBounds);
+			fullLineBounds.origin.x = CGRectGetMinX(frameBounds);
 			
-			for (CFIndex lineIndex = 0; lineIndex < CFArrayGetCount(lines); lineIndex ++)
+			if ([textRenderer textLayoutShouldDebugClipping:self])
 			{
-				CTLineRef line = CFArrayGetValueAtIndex(lines, lineIndex);
-				CGPoint origin = origins[lineIndex];
-				
-				CGContextSetTextPosition(context, origin.x + CGRectGetMinX(frameBounds), origin.y + CGRectGetMinY(frameBounds));
-				CGRect lineBounds = CTLineGetBoundsWithOptions(line, 0);
-				
-				CGPoint lineBoundsOrigin = CGContextGetTextPosition(context);
-				lineBoundsOrigin.y += descender;
-				lineBounds.size.height = lineHeight;
-				lineBounds.origin = lineBoundsOrigin;
-				
-				// Use fullLineBounds to calculate clipping
-				CGRect fullLineBounds = lineBounds;
-				fullLineBounds.size.width = CGRectGetWidth(frameBounds);
-				fullLineBounds.origin.x = CGRectGetMinX(frameBounds);
+				BOOL lineIsBeingClipped = (!CGRectIsEmpty(transformedClippingRect) && CGRectIntersectsRect(fullLineBounds, transformedClippingRect));
 				
-				if ([self.textRenderer textLayoutShouldDebugClipping:self])
+				if (lineIsBeingClipped)
 				{
-					BOOL lineIsBeingClipped = (!CGRectIsEmpty(transformedClippingRect) && CGRectIntersectsRect(fullLineBounds, transformedClippingRect));
+					CGContextSetStrokeColorWithColor(context, [UIColor yellowColor].CGColor);
 					
-					if (lineIsBeingClipped)
-					{
-						CGContextSetStrokeColorWithColor(context, [UIColor yellowColor].CGColor);
-
-						CGContextStrokeRectWithWidth(context, lineBounds, 1);
-					}
-				}
-				
-				CFRange cfLineRange = CTLineGetStringRange(line);
-				NSRange lineRange = NSMakeRange(cfLineRange.location, cfLineRange.length);
-				
-				if (checkForURLs)
-				{
-					[self.attributedString enumerateAttribute:NSUnderlineStyleAttributeName inRange:lineRange options:0 usingBlock:^(id value, NSRange range, BOOL *stop) {
-						if (value)
-						{
-							CGRect URLRect = lineBounds;
-							URLRect.origin.x += CTLineGetOffsetForStringIndex(line, range.location, NULL);
-							URLRect.size.width = CGRectGetMinX(lineBounds) + CTLineGetOffsetForStringIndex(line, NSMaxRange(range), NULL) - CGRectGetMinX(URLRect);
-							URLRect.size.height = font.pointSize;
-							
-							URLRect = CGRectApplyAffineTransform(URLRect, transform);
-							
-							NSRange rangePointer = range;
-							// Get the actual range
-							if ((value = [self.attributedString attribute:PINCHTextLayoutURLStringAttribute atIndex:range.location effectiveRange:&rangePointer]))
-							{
-								[self.textRenderer notifyEncounteredURL:value inRange:rangePointer withRect:URLRect];
-							}
-							else
-							{
-								value = [self.attributedString attribute:PINCHTextLayoutTextCheckingResultAttribute atIndex:range.location effectiveRange:&rangePointer];
-								[self.textRenderer notifyEncounteredTextCheckingResult:value inRange:[(NSTextCheckingResult *)value range] withRect:URLRect];
-							}
-							
-						}
-					}];
-				}
-				
-				static const unichar softHypen = 0x00AD;
-				static const CGFloat justificationFactor = 1;
-				
-				unichar lastChar = 0;
-				NSInteger lastCharLocation = lineRange.location + lineRange.length - 1;
-				if (lastCharLocation < self.attributedString.length)
-				{
-					lastChar = [self.attributedString.string characterAtIndex:lineRange.location + lineRange.length-1];
+					CGContextStrokeRectWithWidth(context, lineBounds, 1);
 				}
-				
-				if (self.breaksLastLine && lineIndex == (CFArrayGetCount(lines) - 1) && (cfLineRange.location + cfLineRange.length) < range.length)
+			}
+			
+			CFRange cfLineRange = CTLineGetStringRange(line);
+			NSRange lineRange = NSMakeRange(cfLineRange.location, cfLineRange.length);
+			
+			if (checkForURLs)
+			{
+				// Only the links that intersect the line, found in the sorted link ranges
+				NSUInteger linkIndex = PINCHTextLayoutLinkRangeIndexAfterLocation(linkRanges, numberOfLinkRanges, lineRange.location);
+				for (; linkIndex < numberOfLinkRanges && linkRanges[linkIndex].range.location < NSMaxRange(lineRange); linkIndex++)
 				{
-					// Show ellipsis when last line range is smaller than total range
-					CFRange effectiveRange = (CFRange)range;
-					CFAttributedStringRef truncationString = CFAttributedStringCreate(NULL, CFSTR("\u2026"), CFAttributedStringGetAttributes((CFAttributedStringRef)self.attributedString, 0, &effectiveRange));
-					CTLineRef truncationToken = CTLineCreateWithAttributedString(truncationString);
-					CFRelease(truncationString);
-					
-					// range to cover everything from the start of lastLine to the end of the string
-					CFRange remainingRange = CFRangeMake(cfLineRange.location, range.length - cfLineRange.location);
-					
-					// substring with that range
-					CFAttributedStringRef longString = CFAttributedStringCreateWithSubstring(NULL, (CFAttributedStringRef)self.attributedString, remainingRange);
-					// line for that string
-					CTLineRef longLine = CTLineCreateWithAttributedString(longString);
-					CFRelease(longString);
-					
-					CGFloat widthAvailable = CGRectGetWidth(frameBounds) - self.lastLineInset;
-					
-					if (!CGRectIsEmpty(transformedClippingRect))
+					const PINCHTextLayoutLinkRange *linkRange = &linkRanges[linkIndex];
+					NSRange range = NSIntersectionRange(linkRange->range, lineRange);
+					if (range.length == 0)
 					{
-						if (CGRectIntersectsRect(fullLineBounds, transformedClippingRect))
-						{
-							CGRect intersection = CGRectIntersection(fullLineBounds, transformedClippingRect);
-							widthAvailable -= CGRectGetWidth(intersection);
-						}
+						continue;
 					}
 					
-					truncatedLine = CTLineCreateTruncatedLine(longLine, widthAvailable, kCTLineTruncationEnd, truncationToken);
-					CFRelease(longLine);
-					CFRelease(truncationToken);
+					CGRect URLRect = lineBounds;
+					URLRect.origin.x += CTLineGetOffsetForStringIndex(line, range.location, NULL);
+					URLRect.size.width = CGRectGetMinX(lineBounds) + CTLineGetOffsetForStringIndex(line, NSMaxRange(range), NULL) - CGRectGetMinX(URLRect);
+					URLRect.size.height = font.pointSize;
 					
-					// if 'truncated' is NULL, then no truncation was required to fit it
-					if (truncatedLine != NULL)
+					URLRect = CGRectApplyAffineTransform(URLRect, transform);
+					
+					if (linkRange->textCheckingResult)
 					{
-						line = truncatedLine;
+						[textRenderer notifyEncounteredTextCheckingResult:linkValues[linkIndex] inRange:linkRange->reportedRange withRect:URLRect];
 					}
-					
-					// Update the lineRect of the textLayout
-					if ([self.lineRects count] > 0)
+					else
 					{
-						NSMutableArray *lineRects = [self.lineRects mutableCopy];
-						CGRect lastLineRect = [[lineRects lastObject] CGRectValue];
-						lastLineRect.size.width = CGRectGetWidth(CTLineGetBoundsWithOptions(line, 0)) - CTLineGetTrailingWhitespaceWidth(line);
-						[lineRects replaceObjectAtIndex:[lineRects count] - 1 withObject:[NSValue valueWithCGRect:lastLineRect]];
-						self.lineRects = lineRects;
+						[textRenderer notifyEncounteredURL:linkValues[linkIndex] inRange:linkRange->reportedRange withRect:URLRect];
 					}
 				}
-				else if (self.hyphenated && lastChar == softHypen && lineRange.length > 0)
+			}
+			
+			static const unichar softHypen = 0x00AD;
+			
+			unichar lastChar = 0;
+			NSInteger lastCharLocation = lineRange.location + lineRange.length - 1;
+			if (lastCharLocation < attributedString.length)
+			{
+				lastChar = [attributedString.string characterAtIndex:lineRange.location + lineRange.length-1];
+			}
+			
+			if (drawingAttributes.breaksLastLine && lineIndex == (numberOfLines - 1) && (layoutResult.isTruncated || (cfLineRange.location + cfLineRange.length) < range.length))
+			{
+				// Show ellipsis when last line range is smaller than total range, the lines of a layoutResult are truncated already
+				if (layoutResult == nil)
 				{
-					NSMutableAttributedString *lineAttrString = [[self.attributedString attributedSubstringFromRange:lineRange] mutableCopy];
-					NSRange replaceRange = NSMakeRange(lineRange.length-1, 1);
-					[lineAttrString replaceCharactersInRange:replaceRange withString:@"-"];
-					
-					hyphenatedLine = CTLineCreateWithAttributedString((__bridge CFAttributedStringRef)lineAttrString);
-					
-					// get the metrics when hyphenated
-					CGFloat lineWidth = CTLineGetTypographicBounds(hyphenatedLine, NULL, NULL, NULL);
-					
-					CGFloat widthAvailable = CGRectGetWidth(frameBounds);
-					
-					// Calculate whether the current line should be clipped by the clippingRect
-					if (!CGRectIsEmpty(transformedClippingRect))
-					{
-						CGRect fullLineBounds = lineBounds;
-						fullLineBounds.size.width = CGRectGetWidth(frameBounds);
-						fullLineBounds.origin.x = CGRectGetMinX(frameBounds);
-						if (CGRectIntersectsRect(fullLineBounds, transformedClippingRect))
-						{
-							CGRect clippedLineBounds = lineBounds;
-							if (CGRectGetMinX(clippedLineBounds) < CGRectGetMinX(transformedClippingRect))
-							{
-								clippedLineBounds.size.width = CGRectGetMinX(transformedClippingRect) - CGRectGetMinX(clippedLineBounds);
-							}
-							else
-							{
-								clippedLineBounds.size.width = CGRectGetMaxX(frameBounds) - CGRectGetMinX(clippedLineBounds);
-							}
-							widthAvailable = CGRectGetWidth(clippedLineBounds);
-						}
-					}
-					
-					line = hyphenatedLine;
+					truncatedLine = [self newTruncatedLineWithLine:line lineRect:lineBounds fitRect:frameBounds clippingRect:transformedClippingRect attributedString:attributedString];
 					
-					if (lineWidth > widthAvailable || self.textAlignment == NSTextAlignmentJustified)
+					// if 'truncated' is NULL, then no truncation was required to fit it
+					if (truncatedLine != NULL)
 					{
-						justifiedLine = CTLineCreateJustifiedLine(hyphenatedLine, justificationFactor, widthAvailable);
-						if (justifiedLine != NULL)
-						{
-							line = justifiedLine;							
-						}
+						line = truncatedLine;
 					}
 				}
+			}
+			else if (drawingAttributes.hyphenated && lastChar == softHypen && lineRange.length > 0)
+			{
+				CGFloat widthAvailable = CGRectGetWidth(frameBounds);
 				
-				if (self.underlined)
+				// Calculate whether the current line should be clipped by the clippingRect
+				if (!CGRectIsEmpty(transformedClippingRect))
 				{
-					if (ctFont == NULL)
-					{
-						ctFont = CTFontCreateWithName((CFStringRef)font.fontName, font.pointSize, &transform);
-					}
-					CGContextSaveGState(context);
+					CGRect fullLineBounds = lineBounds;
+					fullLineBounds.size.width = CGRectGetWidth(frameBounds);
+					fullLineBounds.origin.x = CGRectGetMinX(frameBounds);
+					if (CGRectIntersectsRect(fullLineBounds, transformedClippingRect))
 					{
-						// Don't draw a shadow with underlined text
-						CGContextSetShadowWithColor(context, CGSizeZero, 0.0, NULL);
-						
-						// Get the starting point of the text
-						CGPoint textPoint = CGContextGetTextPosition(context);
-						
-						CGFloat underlinePosition = CTFontGetUnderlinePosition(ctFont);
-						CGFloat underlineThickness = fabs(CTFontGetUnderlineThickness(ctFont));
-						CGFloat width = CTLineGetTypographicBounds(line, NULL, NULL, NULL);
-						CGFloat trailingSpaceWidth = CTLineGetTrailingWhitespaceWidth(line);
-						width -= trailingSpaceWidth;
-						
-						if (fixUnderlinePosition)
+						CGRect clippedLineBounds = lineBounds;
+						if (CGRectGetMinX(clippedLineBounds) < CGRectGetMinX(transformedClippingRect))
 						{
-							// Since iOS 9, positions of underlines in Core Text are slightly shifted
-							// It appears the underlineThickness should be defined in the other direction
-							underlinePosition += underlineThickness;
+							clippedLineBounds.size.width = CGRectGetMinX(transformedClippingRect) - CGRectGetMinX(clippedLineBounds);
 						}
-						
-						// Create a new context for clipping
-						// TODO: create a clipping mask for all lines at once so a new context image doesn't
-						// need to be created for every line. This will improve performance drastically
-						CGImageRef clippingMask = NULL;
-						CGColorSpaceRef colorspace = CGColorSpaceCreateDeviceGray();
-						CGContextRef clippingContext = CGBitmapContextCreate(NULL, CGRectGetWidth(bounds) * scale, CGRectGetHeight(bounds) * scale, 8, 0, colorspace, kNilOptions);
-						CGColorSpaceRelease(colorspace);
-						CGContextConcatCTM(clippingContext, CGAffineTransformMakeScale(scale, scale));
-						CGContextSetFillColorWithColor(clippingContext, [UIColor whiteColor].CGColor);
-						CGContextFillRect(clippingContext, bounds);
-						CGContextSetTextPosition(clippingContext, textPoint.x, textPoint.y);
-						CGContextSetStrokeColorWithColor(clippingContext, [UIColor blackColor].CGColor);
-						CGContextSetLineWidth(clippingContext, floorf(font.pointSize / 8));
-						CGContextSetFillColorWithColor(clippingContext, [UIColor blackColor].CGColor);
-						CGContextSetTextDrawingMode(clippingContext, kCGTextFillStroke);
-					
-						CTLineDraw(line, clippingContext);
-						
-						clippingMask = CGBitmapContextCreateImage(clippingContext);
-						CGContextRelease(clippingContext);
-						
-						// Clip the underline rect
-						CGContextClipToMask(context, bounds, clippingMask);
-						
-						// Draw rect for the underline
-						CGRect textRect = CGRectMake(textPoint.x, textPoint.y - underlinePosition - (underlineThickness * 1.5), (CGFloat)width, underlineThickness * 2.0);
-						CGContextSetFillColorWithColor(context, textColor.CGColor);
-						CGContextFillRect(context, textRect);
-						
-						CGImageRelease(clippingMask);
+						else
+						{
+							clippedLineBounds.size.width = CGRectGetMaxX(frameBounds) - CGRectGetMinX(clippedLineBounds);
+						}
+						widthAvailable = CGRectGetWidth(clippedLineBounds);
 					}
-					CGContextRestoreGState(context);
-				}
-				
-				// Draw the line
-				CTLineDraw(line, context);
-				
-				if (truncatedLine != NULL)
-				{
-					CFRelease(truncatedLine);
-					truncatedLine = NULL;
-				}
-				
-				if (hyphenatedLine != NULL)
-				{
-					CFRelease(hyphenatedLine);
-					hyphenatedLine = NULL;
 				}
 				
-				if (justifiedLine != NULL)
-				{
-					CFRelease(justifiedLine);
-					justifiedLine = NULL;
-				}
+				BOOL justified = (drawingAttributes.textAlignment == NSTextAlignmentJustified);
+				substitutedLine = [self newHyphenatedLineAtIndex:lineIndex withRange:lineRange widthAvailable:widthAvailable fontSize:font.pointSize justified:justified attributedString:attributedString];
+				line = substitutedLine;
 			}
 			
-			free(origins);
-			
-			if (ctFont != NULL)
+			if (drawingAttributes.underlined)
 			{
-				CFRelease(ctFont);
+				// Underlines are drawn after all lines, with gaps around the glyphs
+				CGRect lineFrame = CGRectZero;
+				lineFrame.origin = CGContextGetTextPosition(context);
+				lineFrame.size.width = CTLineGetTypographicBounds(line, NULL, NULL, NULL) - CTLineGetTrailingWhitespaceWidth(line);
+				[underlinedLines addObject:(__bridge id)line];
+				[underlinedLineFrames appendBytes:&lineFrame length:sizeof(CGRect)];
 			}
 			
-			CGPathRelease(framePath);
-			if (frame != NULL)
+			// Draw the line
+			CTLineDraw(line, context);
+			
+			if (truncatedLine != NULL)
 			{
-				CFRelease(frame);
+				CFRelease(truncatedLine);
+				truncatedLine = NULL;
 			}
 			
+			if (substitutedLine != NULL)
+			{
+				CFRelease(substitutedLine);
+				substitutedLine = NULL;
+			}
+		}
+		
+		if ([underlinedLines count] > 0)
+		{
+			[self drawUnderlinesOfLines:underlinedLines frames:[underlinedLineFrames bytes] inContext:context font:font textColor:textColor fixUnderlinePosition:fixUnderlinePosition];
+		}
+		
+		free(origins);
+		CFRelease(lines);
+		
+		CGPathRelease(framePath);
+		if (frame != NULL)
+		{
+			CFRelease(frame);
 		}
-		CGContextRestoreGState(context);
-		[self.textRenderer textLayoutDidRender:self inRect:rect withContext:context];
+		
 	}
+	CGContextRestoreGState(context);
+	[textRenderer textLayoutDidRender:self inRect:rect withContext:context];
 }
 
 - (NSString *)description
@@ -1314,42 +2482,86 @@ NSString *const PINCHTextLayoutTextCheckingResultAttribute = @"PINCHTextChecking
 
 - (CGFloat)scaleFactorStepSize
 {
-	return 0.05f;
+	return (self.scaleFactorPrecision > 0 ? self.scaleFactorPrecision : 0.05f);
 }
 
 - (CGSize)handleBoundsCalculationIterationWithSize:(CGSize)size cappedString:(BOOL)cappedString shouldStop:(BOOL *)shouldStopIterating
 {
 	CGFloat scaleStep = [self scaleFactorStepSize];
+	CGFloat minimumScaleFactor = fminf(self.minimumScaleFactor, 1.0f);
 	
-	// Calculate the middle point of the scaleFactors to create the fallBack when no sizes succeed in fitting
-	// Subclasses overwriting this method can define their own logic for the fallback size
-	CGFloat halfScaleFactor = ((self.actualScaleFactor - self.minimumScaleFactor) / 2);
-	CGFloat multiplier = (1.0f * scaleStep);
-	halfScaleFactor = (roundf(halfScaleFactor * multiplier) / multiplier); // round scaleStep by multiplier
-	halfScaleFactor += self.minimumScaleFactor;
+	// Scale factors are tried in steps down from 1.0f, the last step being the minimumScaleFactor
+	NSInteger maximumStep = MAX((NSInteger)ceilf(((1.0f - minimumScaleFactor) / scaleStep) - 0.001f), 0);
+	CGFloat(^scaleFactorForStep)(NSInteger) = ^CGFloat(NSInteger step) {
+		return (step >= maximumStep ? minimumScaleFactor : 1.0f - (step * scaleStep));
+	};
+	NSInteger(^stepForScaleFactor)(CGFloat) = ^NSInteger(CGFloat scaleFactor) {
+		return MIN(MAX(lroundf((1.0f - scaleFactor) / scaleStep), 0), maximumStep);
+	};
 	
-	if (self.actualScaleFactor == halfScaleFactor)
+	// A smaller scale factor never fits worse, so every iteration narrows down the range
+	// of steps in which the largest fitting scale factor can be found
+	NSInteger step = stepForScaleFactor(_trialScaleFactor);
+	_fittingScaleFactorStep = MIN(_fittingScaleFactorStep, maximumStep + 1);
+	if (cappedString)
 	{
-		_sizeIterationFallbackSize = size;
+		_cappedScaleFactorStep = MAX(_cappedScaleFactorStep, step);
 	}
-	
-	if (self.actualScaleFactor > self.minimumScaleFactor)
+	else
 	{
-		self.actualScaleFactor -= scaleStep;
+		_fittingScaleFactorStep = MIN(_fittingScaleFactorStep, step);
 	}
-	else
+	
+	if (_fittingScaleFactorStep - _cappedScaleFactorStep > 1)
 	{
-		// If smallest size doesn't fit, revert to half the scaleFactor
-		if (cappedString)
+		NSInteger previousStep = (_previousFittedScaleFactor > 0 ? stepForScaleFactor(_previousFittedScaleFactor) : NSNotFound);
+		NSInteger nextStep;
+		if (previousStep != NSNotFound && previousStep > _cappedScaleFactorStep && previousStep < _fittingScaleFactorStep)
+		{
+			// Start at the scale factor that fitted the previous rect
+			nextStep = previousStep;
+		}
+		else if (step == previousStep)
+		{
+			// A slightly different rect usually moves the fitting scale factor by a single step
+			nextStep = (cappedString ? step + 1 : step - 1);
+		}
+		else
 		{
-			self.actualScaleFactor = halfScaleFactor;
+			nextStep = (_cappedScaleFactorStep + _fittingScaleFactorStep) / 2;
 		}
-		self.stringFitsProposedRect = !cappedString;
-		*shouldStopIterating = YES; // Stop the loop
-		size = _sizeIterationFallbackSize;
+		_trialScaleFactor = scaleFactorForStep(nextStep);
+		return size;
 	}
 	
-	return size;
+	if (_fittingScaleFactorStep <= maximumStep)
+	{
+		CGFloat fittingScaleFactor = scaleFactorForStep(_fittingScaleFactorStep);
+		size = [(PINCHTextLayoutTrial *)_scaleFactorTrials[@(fittingScaleFactor)] size];
+		_previousFittedScaleFactor = fittingScaleFactor;
+		self.actualScaleFactor = fittingScaleFactor;
+		self.stringFitsProposedRect = YES;
+		*shouldStopIterating = YES;
+		return size;
+	}
+	
+	// If smallest size doesn't fit, revert to half the scaleFactor
+	// Subclasses overwriting this method can define their own logic for the fallback size
+	CGFloat halfScaleFactor = scaleFactorForStep(maximumStep / 2);
+	PINCHTextLayoutTrial *halfScaleFactorTrial = _scaleFactorTrials[@(halfScaleFactor)];
+	if (!halfScaleFactorTrial)
+	{
+		// Calculate the size at half the scaleFactor in one more iteration
+		_trialScaleFactor = halfScaleFactor;
+		return size;
+	}
+	
+	_sizeIterationFallbackSize = halfScaleFactorTrial.size;
+	self.actualScaleFactor = halfScaleFactor;
+	self.stringFitsProposedRect = NO;
+	*shouldStopIterating = YES; // Stop the loop
+	
+	return _sizeIterationFallbackSize;
 }
 
 @end
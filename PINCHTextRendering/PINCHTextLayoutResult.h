@@ -0,0 +1,100 @@
+//
+//  PINCHTextLayoutResult.h
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+
+@class PINCHTextLayoutResult;
+
+/// Geometry of a single line, stored contiguously for all lines of a layoutResult
+typedef struct {
+	/// The rect of the line, without trailing whitespace
+	CGRect rect;
+	/// The origin of the baseline of the line
+	CGPoint origin;
+	/// The range of the line in the attributed string
+	NSRange range;
+	/// The width of the whitespace at the end of the line
+	CGFloat trailingWhitespaceWidth;
+} PINCHTextLayoutLine;
+
+/// Attributes of the textLayout that influence how its lines are drawn, frozen when a layoutResult is created
+typedef struct {
+	/// The insets of the text within the boundingRect
+	UIEdgeInsets textInsets;
+	/// The alignment of the text, lines ending in a hyphen are justified when it is NSTextAlignmentJustified
+	NSTextAlignment textAlignment;
+	/// Whether a line is drawn under the text
+	BOOL underlined;
+	/// Whether the last line shows an ellipsis
+	BOOL breaksLastLine;
+	/// Whether soft hyphens at the end of lines are drawn as hyphens
+	BOOL hyphenated;
+} PINCHTextLayoutDrawingAttributes;
+
+/**
+ Returns the number of lines of a layoutResult and sets lines to the geometry of all lines,
+ without creating any objects. The buffer is valid as long as the layoutResult exists
+ @param layoutResult The layoutResult to get the lines of
+ @param lines Reference to the pointer that will point to the first line, may be NULL
+ @return The number of lines in the buffer
+ */
+extern NSUInteger PINCHTextLayoutResultGetLines(PINCHTextLayoutResult *layoutResult, const PINCHTextLayoutLine **lines);
+
+/**
+ Immutable result of the size calculation of a textLayout. Holds everything needed to draw the layout,
+ so it can be cached, handed to other threads and drawn without locking the textLayout.
+ */
+@interface PINCHTextLayoutResult : NSObject <NSCopying>
+
+/// The rect the size was calculated in
+@property (nonatomic, assign, readonly) CGRect proposedRect;
+
+/// The clippingRect the size was calculated with, CGRectZero when there was none
+@property (nonatomic, assign, readonly) CGRect clippingRect;
+
+/// The rect the layout will be drawn in, including the textInsets
+@property (nonatomic, assign, readonly) CGRect boundingRect;
+
+/// The scaleFactor applied to make the string fit
+@property (nonatomic, assign, readonly) CGFloat scaleFactor;
+
+/// The number of lines that will be drawn
+@property (nonatomic, assign, readonly) NSUInteger numberOfLines;
+
+/// Whether the string fits in the proposed rect
+@property (nonatomic, assign, readonly) BOOL fitsProposedRect;
+
+/// Whether the last line will be drawn with an ellipsis
+@property (nonatomic, assign, readonly, getter = isTruncated) BOOL truncated;
+
+/// The attributed string as it was laid out, with the scaleFactor applied
+@property (nonatomic, copy, readonly) NSAttributedString *attributedString;
+
+/// The attributes of the textLayout the lines are drawn with
+@property (nonatomic, assign, readonly) PINCHTextLayoutDrawingAttributes drawingAttributes;
+
+/// The NSValue-wrapped CGRect values of all line rects
+/// @note Created when first used, use PINCHTextLayoutResultGetLines() to access the lines without creating objects
+@property (nonatomic, copy, readonly) NSArray *lineRects;
+
+/// The NSValue-wrapped CGPoint values of the baseline origins of all lines
+/// @note Created when first used, use PINCHTextLayoutResultGetLines() to access the lines without creating objects
+@property (nonatomic, copy, readonly) NSArray *lineOrigins;
+
+/// The NSValue-wrapped NSRange values of the string ranges of all lines
+/// @note Created when first used, use PINCHTextLayoutResultGetLines() to access the lines without creating objects
+@property (nonatomic, copy, readonly) NSArray *lineRanges;
+
+/**
+ Returns a result with all rects and origins moved by offset, used to draw the same layout at another position
+ @param offset The horizontal and vertical distance to move the result with
+ */
+- (instancetype)layoutResultWithOffset:(CGPoint)offset;
+
+@end
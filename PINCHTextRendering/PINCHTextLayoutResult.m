@@ -0,0 +1,174 @@
+//
+//  PINCHTextLayoutResult.m
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import "PINCHTextLayoutResult.h"
+
+@interface PINCHTextLayoutResult ()
+
+/// The CTLineRef objects of all lines, with the truncated line in place of the last line
+@property (nonatomic, copy, readonly) NSArray *lines;
+
+/// Sorted link ranges of attributedString with their values, as indexed by the textLayout
+@property (nonatomic, copy, readonly) NSData *linkRangeData;
+@property (nonatomic, copy, readonly) NSArray *linkValues;
+
+@end
+
+@implementation PINCHTextLayoutResult
+{
+	// Contiguous PINCHTextLayoutLine structs of all lines
+	NSData *_lineData;
+}
+
+@synthesize lineRects = _lineRects;
+@synthesize lineOrigins = _lineOrigins;
+@synthesize lineRanges = _lineRanges;
+
+NSUInteger PINCHTextLayoutResultGetLines(PINCHTextLayoutResult *layoutResult, const PINCHTextLayoutLine **lines)
+{
+	NSData *lineData = (layoutResult ? layoutResult->_lineData : nil);
+	if (lines != NULL)
+	{
+		*lines = [lineData bytes];
+	}
+	return [lineData length] / sizeof(PINCHTextLayoutLine);
+}
+
+/// Creates a result with everything the textLayout needs to draw it, lines may be nil for results without typesetting
+- (instancetype)initWithProposedRect:(CGRect)proposedRect clippingRect:(CGRect)clippingRect boundingRect:(CGRect)boundingRect scaleFactor:(CGFloat)scaleFactor numberOfLines:(NSUInteger)numberOfLines fitsProposedRect:(BOOL)fitsProposedRect truncated:(BOOL)truncated attributedString:(NSAttributedString *)attributedString lines:(NSArray *)lines lineData:(NSData *)lineData drawingAttributes:(PINCHTextLayoutDrawingAttributes)drawingAttributes linkRangeData:(NSData *)linkRangeData linkValues:(NSArray *)linkValues
+{
+	self = [super init];
+	if (self)
+	{
+		_proposedRect = proposedRect;
+		_clippingRect = clippingRect;
+		_boundingRect = boundingRect;
+		_scaleFactor = scaleFactor;
+		_numberOfLines = numberOfLines;
+		_fitsProposedRect = fitsProposedRect;
+		_truncated = truncated;
+		_attributedString = [attributedString copy];
+		_lines = [lines copy] ?: @[];
+		_lineData = [lineData copy] ?: [NSData data];
+		_drawingAttributes = drawingAttributes;
+		_linkRangeData = [linkRangeData copy] ?: [NSData data];
+		_linkValues = [linkValues copy] ?: @[];
+	}
+	return self;
+}
+
+- (instancetype)layoutResultWithOffset:(CGPoint)offset
+{
+	if (offset.x == 0 && offset.y == 0)
+	{
+		return self;
+	}
+	
+	PINCHTextLayoutResult *result = [[[self class] alloc] init];
+	result->_scaleFactor = _scaleFactor;
+	result->_numberOfLines = _numberOfLines;
+	result->_fitsProposedRect = _fitsProposedRect;
+	result->_truncated = _truncated;
+	result->_attributedString = _attributedString;
+	result->_lines = _lines;
+	result->_drawingAttributes = _drawingAttributes;
+	result->_linkRangeData = _linkRangeData;
+	result->_linkValues = _linkValues;
+	
+	// Empty rects stay empty so they still compare as 'no rect'
+	result->_proposedRect = CGRectOffset(_proposedRect, offset.x, offset.y);
+	result->_clippingRect = (CGRectIsEmpty(_clippingRect) ? _clippingRect : CGRectOffset(_clippingRect, offset.x, offset.y));
+	result->_boundingRect = (CGRectIsEmpty(_boundingRect) ? _boundingRect : CGRectOffset(_boundingRect, offset.x, offset.y));
+	
+	NSMutableData *lineData = [_lineData mutableCopy];
+	PINCHTextLayoutLine *lines = [lineData mutableBytes];
+	NSUInteger numberOfLines = [lineData length] / sizeof(PINCHTextLayoutLine);
+	for (NSUInteger lineIndex = 0; lineIndex < numberOfLines; lineIndex++)
+	{
+		lines[lineIndex].rect = CGRectOffset(lines[lineIndex].rect, offset.x, offset.y);
+		lines[lineIndex].origin.x += offset.x;
+		lines[lineIndex].origin.y += offset.y;
+	}
+	result->_lineData = lineData;
+	
+	return result;
+}
+
+#pragma mark - Boxed line values
+
+- (NSArray *)lineRects
+{
+	@synchronized(self)
+	{
+		if (!_lineRects)
+		{
+			const PINCHTextLayoutLine *lines = NULL;
+			NSUInteger numberOfLines = PINCHTextLayoutResultGetLines(self, &lines);
+			NSMutableArray *lineRects = [NSMutableArray arrayWithCapacity:numberOfLines];
+			for (NSUInteger lineIndex = 0; lineIndex < numberOfLines; lineIndex++)
+			{
+				[lineRects addObject:[NSValue valueWithCGRect:lines[lineIndex].rect]];
+			}
+			_lineRects = [lineRects copy];
+		}
+		return _lineRects;
+	}
+}
+
+- (NSArray *)lineOrigins
+{
+	@synchronized(self)
+	{
+		if (!_lineOrigins)
+		{
+			const PINCHTextLayoutLine *lines = NULL;
+			NSUInteger numberOfLines = PINCHTextLayoutResultGetLines(self, &lines);
+			NSMutableArray *lineOrigins = [NSMutableArray arrayWithCapacity:numberOfLines];
+			for (NSUInteger lineIndex = 0; lineIndex < numberOfLines; lineIndex++)
+			{
+				[lineOrigins addObject:[NSValue valueWithCGPoint:lines[lineIndex].origin]];
+			}
+			_lineOrigins = [lineOrigins copy];
+		}
+		return _lineOrigins;
+	}
+}
+
+- (NSArray *)lineRanges
+{
+	@synchronized(self)
+	{
+		if (!_lineRanges)
+		{
+			const PINCHTextLayoutLine *lines = NULL;
+			NSUInteger numberOfLines = PINCHTextLayoutResultGetLines(self, &lines);
+			NSMutableArray *lineRanges = [NSMutableArray arrayWithCapacity:numberOfLines];
+			for (NSUInteger lineIndex = 0; lineIndex < numberOfLines; lineIndex++)
+			{
+				[lineRanges addObject:[NSValue valueWithRange:lines[lineIndex].range]];
+			}
+			_lineRanges = [lineRanges copy];
+		}
+		return _lineRanges;
+	}
+}
+
+#pragma mark - NSCopying
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	// Immutable, so the same instance can be shared
+	return self;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"%@, %@, %lu lines", [super description], NSStringFromCGRect(_boundingRect), (unsigned long)_numberOfLines];
+}
+
+@end
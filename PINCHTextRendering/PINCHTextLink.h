@@ -8,6 +8,8 @@
 
 #import <Foundation/Foundation.h>
 
+@class PINCHTextLink;
+
 /// The type of textLink
 typedef NS_ENUM(NSUInteger, PINCHTextLinkType){
 	/// The textLink contains a URL
@@ -16,6 +18,17 @@ typedef NS_ENUM(NSUInteger, PINCHTextLinkType){
 	PINCHTextLinkTypeTextCheckingResult
 };
 
+/**
+ Returns the number of rects of a textLink and sets rects and touchRects to the rects of all lines the link is on,
+ without creating any objects. Rects include the outset of the bezierPath, touchRects are CGRectNull for lines
+ that are high enough to be tapped without a touch region. The buffers are valid until a rect is added to the link
+ @param link The textLink to get the rects of
+ @param rects Reference to the pointer that will point to the first rect, may be NULL
+ @param touchRects Reference to the pointer that will point to the first touch rect, may be NULL
+ @return The number of rects in both buffers
+ */
+extern NSUInteger PINCHTextLinkGetRects(PINCHTextLink *link, const CGRect **rects, const CGRect **touchRects);
+
 /**
  Used to identify links found in textLayout objects while rendering.
  */
@@ -21,6 +21,24 @@ static CGFloat touchMinimumHeight = 44;
 @end
 
 @implementation PINCHTextLink
+{
+	// Contiguous CGRect structs of the outset rect and the touch rect of every line
+	NSMutableData *_rectData;
+	NSMutableData *_touchRectData;
+}
+
+NSUInteger PINCHTextLinkGetRects(PINCHTextLink *link, const CGRect **rects, const CGRect **touchRects)
+{
+	if (rects != NULL)
+	{
+		*rects = (link ? [link->_rectData bytes] : NULL);
+	}
+	if (touchRects != NULL)
+	{
+		*touchRects = (link ? [link->_touchRectData bytes] : NULL);
+	}
+	return (link ? [link->_rectData length] / sizeof(CGRect) : 0);
+}
 
 - (instancetype)initWithURL:(NSURL *)URL range:(NSRange)range rect:(CGRect)rect
 {
@@ -54,14 +72,23 @@ static CGFloat touchMinimumHeight = 44;
 	UIBezierPath *newBezierPath = [UIBezierPath bezierPathWithRoundedRect:rect cornerRadius:linkCornerRadius];
 	
 	UIBezierPath *newTouchBezierPath = nil;
+	CGRect touchRect = CGRectNull;
 	if (CGRectGetHeight(rect) < touchMinimumHeight)
 	{
 		CGFloat verticalOutset = roundf(touchMinimumHeight - CGRectGetHeight(rect));
-		CGRect touchRect = CGRectInset(rect, 0, -verticalOutset);
+		touchRect = CGRectInset(rect, 0, -verticalOutset);
 		
 		newTouchBezierPath = [UIBezierPath bezierPathWithRect:touchRect];
 	}
-		
+	
+	if (!_rectData)
+	{
+		_rectData = [NSMutableData data];
+		_touchRectData = [NSMutableData data];
+	}
+	[_rectData appendBytes:&rect length:sizeof(CGRect)];
+	[_touchRectData appendBytes:&touchRect length:sizeof(CGRect)];
+	
 	if (self.bezierPath)
 	{
 		[self.bezierPath appendPath:newBezierPath];
@@ -0,0 +1,38 @@
+//
+//  PINCHTextLinkIndex.h
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+
+@class PINCHTextLink;
+
+/**
+ Immutable index of the rects of textLinks, used to find the link at a point without testing every link.
+ Rects are divided into horizontal bands, so a lookup only tests the few rects that share the band of the point.
+ */
+@interface PINCHTextLinkIndex : NSObject
+
+/**
+ Creates an index of the links in linkGroups. Links that are exactly at a point are preferred over links with
+ a touch region at the point, after that groups are preferred in the order given, and links within a group
+ in the order of the group
+ @param linkGroups Arrays of PINCHTextLink objects
+ */
+- (instancetype)initWithLinkGroups:(NSArray *)linkGroups;
+
+/// The number of rects in the index, both exact and touch region rects
+@property (nonatomic, assign, readonly) NSUInteger numberOfRects;
+
+/**
+ Returns the preferred link at point
+ @param point CGPoint relative to the bounds in which the layouts are drawn
+ @return The link exactly at point, or the link with a touch region at point, or nil when there is none
+ */
+- (PINCHTextLink *)linkAtPoint:(CGPoint)point;
+
+@end
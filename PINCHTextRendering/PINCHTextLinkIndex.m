@@ -0,0 +1,152 @@
+//
+//  PINCHTextLinkIndex.m
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import "PINCHTextLinkIndex.h"
+#import "PINCHTextLink.h"
+
+/// Height of a band, about a line of text so most rects are in one or two bands
+static CGFloat bandHeight = 24;
+
+/// A rect of a link in a single band
+typedef struct {
+	NSInteger band;
+	/// Lower is preferred, exact rects of all groups come before the touch rects of all groups
+	NSUInteger priority;
+	NSUInteger linkIndex;
+	CGRect rect;
+	BOOL touchRegion;
+} PINCHTextLinkIndexEntry;
+
+/// Sorts entries by band, then by preference
+static int PINCHTextLinkIndexEntryCompare(const void *first, const void *second)
+{
+	const PINCHTextLinkIndexEntry *firstEntry = first;
+	const PINCHTextLinkIndexEntry *secondEntry = second;
+	if (firstEntry->band != secondEntry->band)
+	{
+		return (firstEntry->band < secondEntry->band ? -1 : 1);
+	}
+	if (firstEntry->priority != secondEntry->priority)
+	{
+		return (firstEntry->priority < secondEntry->priority ? -1 : 1);
+	}
+	return (firstEntry->linkIndex < secondEntry->linkIndex ? -1 : (firstEntry->linkIndex > secondEntry->linkIndex ? 1 : 0));
+}
+
+static inline NSInteger PINCHTextLinkIndexBand(CGFloat y)
+{
+	return (NSInteger)floor(y / bandHeight);
+}
+
+@implementation PINCHTextLinkIndex
+{
+	// All links of all groups, referenced by the entries
+	NSArray *_links;
+	// Contiguous PINCHTextLinkIndexEntry structs, sorted by band and preference
+	NSData *_entryData;
+}
+
+- (instancetype)initWithLinkGroups:(NSArray *)linkGroups
+{
+	self = [super init];
+	if (self)
+	{
+		NSMutableArray *links = [NSMutableArray array];
+		NSMutableData *entryData = [NSMutableData data];
+		NSUInteger numberOfGroups = [linkGroups count];
+		
+		for (NSUInteger groupIndex = 0; groupIndex < numberOfGroups; groupIndex++)
+		{
+			for (PINCHTextLink *link in linkGroups[groupIndex])
+			{
+				const CGRect *rects = NULL;
+				const CGRect *touchRects = NULL;
+				NSUInteger numberOfRects = PINCHTextLinkGetRects(link, &rects, &touchRects);
+				for (NSUInteger rectIndex = 0; rectIndex < numberOfRects; rectIndex++)
+				{
+					for (NSUInteger touchRegion = 0; touchRegion <= 1; touchRegion++)
+					{
+						CGRect rect = (touchRegion ? touchRects[rectIndex] : rects[rectIndex]);
+						if (CGRectIsNull(rect))
+						{
+							continue;
+						}
+						
+						// Added to every band the rect overlaps, so a lookup only needs the band of the point
+						PINCHTextLinkIndexEntry entry;
+						memset(&entry, 0, sizeof(entry));
+						entry.priority = (touchRegion * numberOfGroups) + groupIndex;
+						entry.linkIndex = [links count];
+						entry.rect = rect;
+						entry.touchRegion = (BOOL)touchRegion;
+						NSInteger lastBand = PINCHTextLinkIndexBand(CGRectGetMaxY(rect));
+						for (entry.band = PINCHTextLinkIndexBand(CGRectGetMinY(rect)); entry.band <= lastBand; entry.band++)
+						{
+							[entryData appendBytes:&entry length:sizeof(entry)];
+						}
+					}
+				}
+				[links addObject:link];
+			}
+		}
+		
+		qsort([entryData mutableBytes], [entryData length] / sizeof(PINCHTextLinkIndexEntry), sizeof(PINCHTextLinkIndexEntry), PINCHTextLinkIndexEntryCompare);
+		
+		_links = [links copy];
+		_entryData = [entryData copy];
+	}
+	return self;
+}
+
+- (NSUInteger)numberOfRects
+{
+	return [_entryData length] / sizeof(PINCHTextLinkIndexEntry);
+}
+
+- (PINCHTextLink *)linkAtPoint:(CGPoint)point
+{
+	const PINCHTextLinkIndexEntry *entries = [_entryData bytes];
+	NSUInteger numberOfEntries = [self numberOfRects];
+	NSInteger band = PINCHTextLinkIndexBand(point.y);
+	
+	// Binary search for the first entry of the band
+	NSUInteger lower = 0;
+	NSUInteger upper = numberOfEntries;
+	while (lower < upper)
+	{
+		NSUInteger middle = lower + (upper - lower) / 2;
+		if (entries[middle].band < band)
+		{
+			lower = middle + 1;
+		}
+		else
+		{
+			upper = middle;
+		}
+	}
+	
+	// Entries of the band are sorted by preference, so the first one that contains the point wins
+	for (NSUInteger index = lower; index < numberOfEntries && entries[index].band == band; index++)
+	{
+		const PINCHTextLinkIndexEntry *entry = &entries[index];
+		if (!CGRectContainsPoint(entry->rect, point))
+		{
+			continue;
+		}
+		
+		PINCHTextLink *link = _links[entry->linkIndex];
+		// Exact rects have rounded corners, only the path of the link is accurate there
+		if (entry->touchRegion || [link containsPoint:point])
+		{
+			return link;
+		}
+	}
+	return nil;
+}
+
+@end
@@ -0,0 +1,92 @@
+//
+//  PINCHTextMeasurementCache.h
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+
+/// The initial value to pass to PINCHTextMeasurementHash()
+extern const uint64_t PINCHTextMeasurementHashInitial;
+
+/**
+ Continues a 64-bit FNV-1a hash with the given bytes, used to create the keys of the measurementCache
+ @param hash The hash so far, PINCHTextMeasurementHashInitial for the first bytes
+ @param bytes The bytes to add to the hash
+ @param length The number of bytes
+ @return The hash including the given bytes
+ */
+extern uint64_t PINCHTextMeasurementHash(uint64_t hash, const void *bytes, size_t length);
+
+/// The outcome of a size calculation, without any line geometry
+typedef struct {
+	/// The bounding rect relative to the origin of the proposed rect
+	CGRect boundingRect;
+	/// The scaleFactor applied to make the string fit
+	CGFloat scaleFactor;
+	/// The number of lines that will be drawn
+	NSUInteger numberOfLines;
+	/// Whether the string fits in the proposed rect
+	BOOL fitsProposedRect;
+} PINCHTextMeasurement;
+
+/**
+ Persistent cache of measurements, so the same strings don't need to be typeset again after every launch.
+ The measurements are stored in a memory-mapped file of a fixed size, reading them doesn't involve CoreText or parsing.
+ The file is recreated when it is corrupt, was written by another version, or on another OS version.
+ When the file is full, the least recently used of the entries a key can be stored in is replaced.
+ Processes that open the same file, like an app and its extensions, share the measurements. The file is locked
+ while measurements are read or written, so they never see each other's half-written entries.
+ */
+@interface PINCHTextMeasurementCache : NSObject
+
+/**
+ The cache textLayouts use in boundingRectForProposedRect:withClippingRect:containerRect:. Default is nil,
+ in which case nothing is persisted. Measurements with a clippingRect are never persisted.
+ */
++ (PINCHTextMeasurementCache *)defaultCache;
+
+/**
+ Sets the cache used by all textLayouts
+ @param measurementCache The cache to use, or nil to stop persisting measurements
+ */
++ (void)setDefaultCache:(PINCHTextMeasurementCache *)measurementCache;
+
+/**
+ Opens or creates the cache file
+ @param fileURL The file URL of the cache, typically inside the caches directory
+ @param maximumFileSize The size of the cache file in bytes, which determines how many measurements fit
+ */
+- (instancetype)initWithFileURL:(NSURL *)fileURL maximumFileSize:(NSUInteger)maximumFileSize;
+
+/// The URL of the cache file
+@property (nonatomic, copy, readonly) NSURL *fileURL;
+
+/// The number of measurements that fit in the cache file
+@property (nonatomic, assign, readonly) NSUInteger capacity;
+
+/**
+ Reads a measurement from the cache
+ @param measurement Reference to the measurement that will be set when found
+ @param key The key of the measurement
+ @return Whether a valid measurement was found
+ */
+- (BOOL)getMeasurement:(PINCHTextMeasurement *)measurement forKey:(uint64_t)key;
+
+/**
+ Stores a measurement, replacing a least recently used one when there's no room
+ @param measurement The measurement to store
+ @param key The key of the measurement
+ */
+- (void)setMeasurement:(PINCHTextMeasurement)measurement forKey:(uint64_t)key;
+
+/// Removes all measurements from the cache file
+- (void)removeAllMeasurements;
+
+/// Schedules writing changed measurements to disk, the system writes them eventually as well
+- (void)synchronize;
+
+@end
@@ -0,0 +1,341 @@
+//
+//  PINCHTextMeasurementCache.m
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import "PINCHTextMeasurementCache.h"
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint64_t PINCHTextMeasurementHashInitial = 0xcbf29ce484222325ULL;
+
+/// Increase when the layout calculation or the file format changes, so old measurements are discarded
+static const uint32_t PINCHTextMeasurementCacheVersion = 1;
+static const uint32_t PINCHTextMeasurementCacheMagic = 'PTMC';
+
+/// The number of consecutive entries a key can be stored in
+static const uint32_t PINCHTextMeasurementCacheProbeLength = 16;
+
+static const uint32_t PINCHTextMeasurementEntryOccupied = 1 << 0;
+static const uint32_t PINCHTextMeasurementEntryFits = 1 << 1;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t environmentHash;
+	uint32_t entrySize;
+	uint32_t capacity;
+	/// Checksum of all fields above
+	uint64_t checksum;
+	/// Counter increased with every use, to find the least recently used entries
+	uint32_t clock;
+	uint32_t reserved;
+} PINCHTextMeasurementCacheHeader;
+
+typedef struct {
+	uint64_t key;
+	double x;
+	double y;
+	double width;
+	double height;
+	double scaleFactor;
+	uint32_t numberOfLines;
+	uint32_t flags;
+	/// Checksum of all fields above
+	uint32_t checksum;
+	/// Not part of the checksum, so using an entry only writes this field
+	uint32_t lastUse;
+} PINCHTextMeasurementEntry;
+
+uint64_t PINCHTextMeasurementHash(uint64_t hash, const void *bytes, size_t length)
+{
+	const uint8_t *byte = bytes;
+	for (size_t index = 0; index < length; index++)
+	{
+		hash ^= byte[index];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t PINCHTextMeasurementHeaderChecksum(const PINCHTextMeasurementCacheHeader *header)
+{
+	return PINCHTextMeasurementHash(PINCHTextMeasurementHashInitial, header, offsetof(PINCHTextMeasurementCacheHeader, checksum));
+}
+
+static uint32_t PINCHTextMeasurementEntryChecksum(const PINCHTextMeasurementEntry *entry)
+{
+	uint64_t hash = PINCHTextMeasurementHash(PINCHTextMeasurementHashInitial, entry, offsetof(PINCHTextMeasurementEntry, checksum));
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static PINCHTextMeasurementCache *defaultCache = nil;
+
+@implementation PINCHTextMeasurementCache
+{
+	int _fileDescriptor;
+	size_t _fileSize;
+	PINCHTextMeasurementCacheHeader *_header;
+	PINCHTextMeasurementEntry *_entries;
+}
+
++ (PINCHTextMeasurementCache *)defaultCache
+{
+	@synchronized(self)
+	{
+		return defaultCache;
+	}
+}
+
++ (void)setDefaultCache:(PINCHTextMeasurementCache *)measurementCache
+{
+	@synchronized(self)
+	{
+		defaultCache = measurementCache;
+	}
+}
+
+- (instancetype)initWithFileURL:(NSURL *)fileURL maximumFileSize:(NSUInteger)maximumFileSize
+{
+	NSParameterAssert([fileURL isFileURL]);
+	
+	self = [super init];
+	if (self)
+	{
+		_fileURL = [fileURL copy];
+		_fileDescriptor = -1;
+		
+		uint32_t capacity = (uint32_t)MIN((maximumFileSize - MIN(maximumFileSize, sizeof(PINCHTextMeasurementCacheHeader))) / sizeof(PINCHTextMeasurementEntry), UINT32_MAX);
+		if (capacity >= PINCHTextMeasurementCacheProbeLength)
+		{
+			[self openFileWithCapacity:capacity];
+		}
+	}
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_header != NULL)
+	{
+		munmap(_header, _fileSize);
+	}
+	if (_fileDescriptor >= 0)
+	{
+		close(_fileDescriptor);
+	}
+}
+
+#pragma mark - File
+
+/// Identifies the text system the measurements were made with, as CoreText may lay out differently on another OS version
+- (uint64_t)environmentHash
+{
+	NSString *environment = [[NSProcessInfo processInfo] operatingSystemVersionString];
+	const char *bytes = [environment UTF8String];
+	return PINCHTextMeasurementHash(PINCHTextMeasurementHashInitial, bytes, strlen(bytes));
+}
+
+/// Opens the cache file with an exclusive lock and gives it fileSize, returns -1 when that fails.
+/// A file of another size is replaced by a new file instead of being resized, because another process
+/// may have mapped it and would crash when reading beyond its new end
+- (int)openLockedFileWithSize:(size_t)fileSize
+{
+	const char *path = [[self.fileURL path] fileSystemRepresentation];
+	for (NSUInteger attempt = 0; attempt < 2; attempt++)
+	{
+		int fileDescriptor = open(path, O_RDWR | O_CREAT, 0644);
+		if (fileDescriptor < 0)
+		{
+			return -1;
+		}
+		
+		struct stat fileStatus;
+		if (flock(fileDescriptor, LOCK_EX) != 0 || fstat(fileDescriptor, &fileStatus) != 0)
+		{
+			close(fileDescriptor);
+			return -1;
+		}
+		
+		if ((size_t)fileStatus.st_size == fileSize)
+		{
+			return fileDescriptor;
+		}
+		if (fileStatus.st_size == 0)
+		{
+			if (ftruncate(fileDescriptor, (off_t)fileSize) == 0)
+			{
+				return fileDescriptor;
+			}
+			close(fileDescriptor);
+			return -1;
+		}
+		
+		unlink(path);
+		close(fileDescriptor);
+	}
+	return -1;
+}
+
+/// Maps the cache file into memory, starting with an empty file when the existing one can't be trusted.
+/// The cache stays disabled when the file can't be opened or mapped
+- (void)openFileWithCapacity:(uint32_t)capacity
+{
+	size_t fileSize = sizeof(PINCHTextMeasurementCacheHeader) + (size_t)capacity * sizeof(PINCHTextMeasurementEntry);
+	
+	int fileDescriptor = [self openLockedFileWithSize:fileSize];
+	if (fileDescriptor < 0)
+	{
+		return;
+	}
+	
+	void *bytes = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+	if (bytes == MAP_FAILED)
+	{
+		close(fileDescriptor);
+		return;
+	}
+	
+	_fileDescriptor = fileDescriptor;
+	_fileSize = fileSize;
+	_header = bytes;
+	_entries = (PINCHTextMeasurementEntry *)(_header + 1);
+	_capacity = capacity;
+	
+	PINCHTextMeasurementCacheHeader header = {
+		.magic = PINCHTextMeasurementCacheMagic,
+		.version = PINCHTextMeasurementCacheVersion,
+		.environmentHash = [self environmentHash],
+		.entrySize = sizeof(PINCHTextMeasurementEntry),
+		.capacity = capacity,
+	};
+	header.checksum = PINCHTextMeasurementHeaderChecksum(&header);
+	
+	if (memcmp(_header, &header, offsetof(PINCHTextMeasurementCacheHeader, clock)) != 0)
+	{
+		// New, corrupt or outdated, all entries are discarded
+		memset(_entries, 0, fileSize - sizeof(PINCHTextMeasurementCacheHeader));
+		*_header = header;
+	}
+	flock(fileDescriptor, LOCK_UN);
+}
+
+#pragma mark - Measurements
+
+- (BOOL)getMeasurement:(PINCHTextMeasurement *)measurement forKey:(uint64_t)key
+{
+	@synchronized(self)
+	{
+		if (_header == NULL)
+		{
+			return NO;
+		}
+		
+		BOOL found = NO;
+		flock(_fileDescriptor, LOCK_EX);
+		for (uint32_t probe = 0; probe < PINCHTextMeasurementCacheProbeLength; probe++)
+		{
+			PINCHTextMeasurementEntry *entry = &_entries[(key + probe) % _capacity];
+			if (!(entry->flags & PINCHTextMeasurementEntryOccupied))
+			{
+				break;
+			}
+			
+			if (entry->key != key || entry->checksum != PINCHTextMeasurementEntryChecksum(entry))
+			{
+				continue;
+			}
+			
+			entry->lastUse = ++_header->clock;
+			if (measurement != NULL)
+			{
+				measurement->boundingRect = CGRectMake(entry->x, entry->y, entry->width, entry->height);
+				measurement->scaleFactor = entry->scaleFactor;
+				measurement->numberOfLines = entry->numberOfLines;
+				measurement->fitsProposedRect = ((entry->flags & PINCHTextMeasurementEntryFits) != 0);
+			}
+			found = YES;
+			break;
+		}
+		flock(_fileDescriptor, LOCK_UN);
+		return found;
+	}
+}
+
+- (void)setMeasurement:(PINCHTextMeasurement)measurement forKey:(uint64_t)key
+{
+	@synchronized(self)
+	{
+		if (_header == NULL)
+		{
+			return;
+		}
+		
+		flock(_fileDescriptor, LOCK_EX);
+		
+		// Use the entry with the same key or the first empty one, otherwise replace the least recently used
+		PINCHTextMeasurementEntry *entry = NULL;
+		for (uint32_t probe = 0; probe < PINCHTextMeasurementCacheProbeLength; probe++)
+		{
+			PINCHTextMeasurementEntry *probedEntry = &_entries[(key + probe) % _capacity];
+			if (!(probedEntry->flags & PINCHTextMeasurementEntryOccupied) || probedEntry->key == key)
+			{
+				entry = probedEntry;
+				break;
+			}
+			if (entry == NULL || probedEntry->lastUse < entry->lastUse)
+			{
+				entry = probedEntry;
+			}
+		}
+		
+		PINCHTextMeasurementEntry newEntry = {
+			.key = key,
+			.x = measurement.boundingRect.origin.x,
+			.y = measurement.boundingRect.origin.y,
+			.width = measurement.boundingRect.size.width,
+			.height = measurement.boundingRect.size.height,
+			.scaleFactor = measurement.scaleFactor,
+			.numberOfLines = (uint32_t)measurement.numberOfLines,
+			.flags = PINCHTextMeasurementEntryOccupied | (measurement.fitsProposedRect ? PINCHTextMeasurementEntryFits : 0),
+			.lastUse = ++_header->clock,
+		};
+		newEntry.checksum = PINCHTextMeasurementEntryChecksum(&newEntry);
+		*entry = newEntry;
+		
+		flock(_fileDescriptor, LOCK_UN);
+	}
+}
+
+- (void)removeAllMeasurements
+{
+	@synchronized(self)
+	{
+		if (_header != NULL)
+		{
+			flock(_fileDescriptor, LOCK_EX);
+			memset(_entries, 0, _fileSize - sizeof(PINCHTextMeasurementCacheHeader));
+			_header->clock = 0;
+			flock(_fileDescriptor, LOCK_UN);
+		}
+	}
+}
+
+- (void)synchronize
+{
+	@synchronized(self)
+	{
+		if (_header != NULL)
+		{
+			msync(_header, _fileSize, MS_ASYNC);
+		}
+	}
+}
+
+@end
@@ -0,0 +1,68 @@
+//
+//  PINCHTextPrefetcher.h
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+
+@class PINCHTextLayout;
+@class PINCHTextRenderer;
+
+/**
+ Token returned for every prefetch request. Cancelling it stops the measurement
+ between two scale factor iterations and prevents the completion from being called.
+ */
+@interface PINCHTextPrefetchToken : NSObject
+
+/// Whether the request has been cancelled, either by calling cancel or by a newer request for the same target
+@property (atomic, assign, readonly, getter = isCancelled) BOOL cancelled;
+
+/// Cancels the request, the completion will not be called afterwards
+- (void)cancel;
+
+@end
+
+/**
+ Measures textRenderers and textLayouts on background threads ahead of drawing, for instance for cells that
+ are about to scroll into view. The results end up in the layout caches, so drawing them doesn't need to measure.
+ Requesting a target again with another width cancels the previous request for that target.
+ */
+@interface PINCHTextPrefetcher : NSObject
+
+/// Returns the prefetcher shared by the whole app
++ (instancetype)sharedPrefetcher;
+
+/**
+ Measures all textLayouts of the textRenderer in the given width
+ @param textRenderer The textRenderer to measure
+ @param width The width the textRenderer will be drawn in
+ @param priority The priority of the request, requests for visible content should be higher than those for content further away
+ @param completion Called on the main queue with the bounding rect of the textRenderer, not called when cancelled
+ @return Token to cancel the request with
+ */
+- (PINCHTextPrefetchToken *)prefetchTextRenderer:(PINCHTextRenderer *)textRenderer width:(CGFloat)width priority:(NSOperationQueuePriority)priority completion:(void (^)(CGRect boundingRect))completion;
+
+/**
+ Measures the textLayout in the given width
+ @param textLayout The textLayout to measure
+ @param width The width the textLayout will be drawn in
+ @param priority The priority of the request, requests for visible content should be higher than those for content further away
+ @param completion Called on the main queue with the bounding rect of the textLayout, not called when cancelled
+ @return Token to cancel the request with
+ */
+- (PINCHTextPrefetchToken *)prefetchTextLayout:(PINCHTextLayout *)textLayout width:(CGFloat)width priority:(NSOperationQueuePriority)priority completion:(void (^)(CGRect boundingRect))completion;
+
+/**
+ Cancels the pending request for a textRenderer or textLayout
+ @param target The textRenderer or textLayout to stop measuring
+ */
+- (void)cancelPrefetchForTarget:(id)target;
+
+/// Cancels all pending requests
+- (void)cancelAllPrefetches;
+
+@end
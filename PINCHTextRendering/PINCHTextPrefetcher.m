@@ -0,0 +1,184 @@
+//
+//  PINCHTextPrefetcher.m
+//  PINCHTextRendering
+//
+//  Created by PINCH on 10/17/26.
+//  Copyright (c) 2026 PINCH B.V. All rights reserved.
+//
+
+#import "PINCHTextPrefetcher.h"
+#import "PINCHTextLayout.h"
+#import "PINCHTextLayoutResult.h"
+#import "PINCHTextRenderer.h"
+
+@interface PINCHTextLayout ()
+
+/// Measuring that can be cancelled between scale factor iterations
+- (PINCHTextLayoutResult *)layoutResultForProposedRect:(CGRect)proposedRect withClippingRect:(CGRect *)clippingRect containerRect:(CGRect)containerRect cancelToken:(PINCHTextPrefetchToken *)cancelToken;
+
+@end
+
+@interface PINCHTextRenderer ()
+
+/// Measuring that can be cancelled between textLayouts
+- (CGRect)boundingRectForLayoutsInProposedRect:(CGRect)rect cancelToken:(PINCHTextPrefetchToken *)cancelToken;
+
+@end
+
+@interface PINCHTextPrefetchToken ()
+
+@property (atomic, assign, readwrite, getter = isCancelled) BOOL cancelled;
+@property (nonatomic, weak) NSOperation *operation;
+@property (nonatomic, assign) CGFloat width;
+
+@end
+
+@implementation PINCHTextPrefetchToken
+
+- (void)cancel
+{
+	self.cancelled = YES;
+	[self.operation cancel];
+}
+
+@end
+
+@interface PINCHTextPrefetcher ()
+
+@property (nonatomic, strong) NSOperationQueue *queue;
+
+/// The latest token of every target, the targets aren't retained
+@property (nonatomic, strong) NSMapTable *tokens;
+
+@end
+
+@implementation PINCHTextPrefetcher
+
++ (instancetype)sharedPrefetcher
+{
+	static PINCHTextPrefetcher *sharedPrefetcher = nil;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		sharedPrefetcher = [[self alloc] init];
+	});
+	return sharedPrefetcher;
+}
+
+- (instancetype)init
+{
+	self = [super init];
+	if (self)
+	{
+		_queue = [[NSOperationQueue alloc] init];
+		_queue.name = @"PINCHTextPrefetcher";
+		_queue.maxConcurrentOperationCount = [[NSProcessInfo processInfo] activeProcessorCount];
+		_tokens = [NSMapTable weakToStrongObjectsMapTable];
+	}
+	return self;
+}
+
+#pragma mark - Requests
+
+- (PINCHTextPrefetchToken *)prefetchTextRenderer:(PINCHTextRenderer *)textRenderer width:(CGFloat)width priority:(NSOperationQueuePriority)priority completion:(void (^)(CGRect))completion
+{
+	return [self prefetchTarget:textRenderer width:width priority:priority completion:completion measuring:^CGRect(CGRect rect, PINCHTextPrefetchToken *token) {
+		return [textRenderer boundingRectForLayoutsInProposedRect:rect cancelToken:token];
+	}];
+}
+
+- (PINCHTextPrefetchToken *)prefetchTextLayout:(PINCHTextLayout *)textLayout width:(CGFloat)width priority:(NSOperationQueuePriority)priority completion:(void (^)(CGRect))completion
+{
+	return [self prefetchTarget:textLayout width:width priority:priority completion:completion measuring:^CGRect(CGRect rect, PINCHTextPrefetchToken *token) {
+		CGRect clippingRect = CGRectZero;
+		return [textLayout layoutResultForProposedRect:rect withClippingRect:&clippingRect containerRect:rect cancelToken:token].boundingRect;
+	}];
+}
+
+- (PINCHTextPrefetchToken *)prefetchTarget:(id)target width:(CGFloat)width priority:(NSOperationQueuePriority)priority completion:(void (^)(CGRect))completion measuring:(CGRect (^)(CGRect rect, PINCHTextPrefetchToken *token))measuring
+{
+	NSParameterAssert(target);
+	
+	PINCHTextPrefetchToken *token = [[PINCHTextPrefetchToken alloc] init];
+	token.width = width;
+	
+	@synchronized(self)
+	{
+		// A request for another width makes the pending one useless, one for the same width will hit the layout cache
+		PINCHTextPrefetchToken *previousToken = [self.tokens objectForKey:target];
+		if (previousToken && previousToken.width != width)
+		{
+			[previousToken cancel];
+		}
+		[self.tokens setObject:token forKey:target];
+	}
+	
+	// The token only references the operation weakly, so the operation can keep the token alive
+	NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+		if (token.isCancelled)
+		{
+			return;
+		}
+		
+		// The same height CGFLOAT_MAX is replaced with by the textLayouts
+		CGRect boundingRect = measuring(CGRectMake(0, 0, width, 100000), token);
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (token.isCancelled)
+			{
+				return;
+			}
+			
+			[self finishToken:token forTarget:target];
+			if (completion)
+			{
+				completion(boundingRect);
+			}
+		});
+	}];
+	operation.queuePriority = priority;
+	token.operation = operation;
+	
+	[self.queue addOperation:operation];
+	return token;
+}
+
+- (void)finishToken:(PINCHTextPrefetchToken *)token forTarget:(id)target
+{
+	@synchronized(self)
+	{
+		if ([self.tokens objectForKey:target] == token)
+		{
+			[self.tokens removeObjectForKey:target];
+		}
+	}
+}
+
+#pragma mark - Cancelling
+
+- (void)cancelPrefetchForTarget:(id)target
+{
+	if (!target)
+	{
+		return;
+	}
+	
+	@synchronized(self)
+	{
+		[[self.tokens objectForKey:target] cancel];
+		[self.tokens removeObjectForKey:target];
+	}
+}
+
+- (void)cancelAllPrefetches
+{
+	@synchronized(self)
+	{
+		for (PINCHTextPrefetchToken *token in [self.tokens objectEnumerator])
+		{
+			[token cancel];
+		}
+		[self.tokens removeAllObjects];
+	}
+}
+
+@end
@@ -7,8 +7,10 @@
 //
 
 #import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
 
 @class PINCHTextLayout;
+@class PINCHTextBitmapCache;
 @protocol PINCHTextRendererDelegate;
 
 /**
@@ -69,6 +71,12 @@
  */
 @property (nonatomic, assign) CGRect clippingRect;
 
+/**
+ When set, textLayouts are rendered into images that are kept in the cache, and drawing identical textLayouts
+ in the same size draws the cached image instead. Default is nil, PINCHTextView uses the sharedCache when its usesBitmapCache is set
+ */
+@property (nonatomic, strong) PINCHTextBitmapCache *bitmapCache;
+
 /**
  Returns the clipping rect if it intersects with the given rect
  */
@@ -84,6 +92,25 @@
  */
 - (CGRect)boundingRectForLayoutsInProposedRect:(CGRect)rect;
 
+/**
+ Calculates the bounding rects of many textRenderers at once, spreading the work over the available cores.
+ Each textRenderer is measured in a rect at the origin with the given width and unlimited height
+ @param textRenderers NSArray of PINCHTextRenderer instances
+ @param widths NSArray of NSNumber widths for every textRenderer, or a single width to use for all textRenderers
+ @return NSArray of NSValue-wrapped CGRects in the same order as textRenderers
+ @note The delegate calls of the textRenderers are made from the threads the measurements are done on
+ */
++ (NSArray *)boundingRectsForTextRenderers:(NSArray *)textRenderers withWidths:(NSArray *)widths;
+
+/**
+ Calculates the bounding rects of many textLayouts at once, spreading the work over the available cores.
+ Each textLayout is measured in a rect at the origin with the given width and unlimited height
+ @param textLayouts NSArray of PINCHTextLayout instances
+ @param widths NSArray of NSNumber widths for every textLayout, or a single width to use for all textLayouts
+ @return NSArray of NSValue-wrapped CGRects in the same order as textLayouts
+ */
++ (NSArray *)boundingRectsForTextLayouts:(NSArray *)textLayouts withWidths:(NSArray *)widths;
+
 /**
  Renders all textLayout objects in the textLayouts array in the right order.
  The textLayout objects are rendered from top to bottom and each textLayout object is
@@ -94,6 +121,16 @@
  */
 - (void)renderTextLayoutsInContext:(CGContextRef)context withRect:(CGRect)rect;
 
+/**
+ Renders all textLayouts into a new image like renderTextLayoutsInContext:withRect:, with the rect at the origin.
+ Doesn't use UIKit drawing, so it can be called from any thread, also for the same textRenderer from several threads
+ @param size The size of the image in points
+ @param scale The number of pixels per point of the image
+ @return A transparent image with the rendered textLayouts, or nil when size is empty
+ @note The delegate calls are made from the thread this method is called on
+ */
+- (UIImage *)imageOfTextLayoutsWithSize:(CGSize)size scale:(CGFloat)scale;
+
 /**
  Renders a specific textLayout in the given context placed at the given rect, clipped by the given rect.
  Called by renderTextLayoutsInContext:withRect for each textLayout object in textLayouts
@@ -125,6 +162,7 @@
  @param rect The CGRect containing the textLayout object
  @param textLayout Instance of PINCHTextLayout which boundingRect has been calculated
  @warning This method will be called from the thread in which the renderTextLayoutsInContext:withRect: is called
+ @note When a PINCHTextView displays asynchronously, this is called on the main thread after rendering
  */
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer didCalculateBoundingRect:(CGRect)rect forTextLayout:(PINCHTextLayout *)textLayout;
 
@@ -136,6 +174,7 @@
  @param textLayouts NSArray of instances of PINCHTextLayout that will be drawn
  @return BOOL whether the textLayout objects should be drawn. Returning NO will recalculate the bounds.
  @warning This method will be called from the thread in which the renderTextLayoutsInContext:withRect: is called
+ @note Not called when a PINCHTextView displays asynchronously, the textLayouts are always drawn
  @note Repeatedly returning NO will result in the textRendering not drawing the layouts at all, to prevent an endless loop.
  */
 - (BOOL)textRenderer:(PINCHTextRenderer *)textRenderer shouldRenderTextLayouts:(NSArray *)textLayouts;
@@ -147,6 +186,7 @@
  @param rect The CGRect containing the textLayout object
  @param context CGContextRef where the textLayout object will be rendered in
  @warning This method will be called from the thread in which the renderTextLayoutsInContext:withRect: is called
+ @note When a PINCHTextView displays asynchronously, this is called on the main thread after rendering, with a NULL context
  */
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer willRenderTextLayout:(PINCHTextLayout *)textLayout inRect:(CGRect)rect withContext:(CGContextRef)context;
 
@@ -157,6 +197,7 @@
  @param rect The CGRect containing the all the rects in which the textLayouts will be rendered
  @param context CGContextRef where the textLayout objects will be rendered in
  @warning This method will be called from the thread in which the renderTextLayoutsInContext:withRect: is called
+ @note When a PINCHTextView displays asynchronously, this is called on the main thread after rendering, with a NULL context
  @note The array of textLayouts may contain less objects than all provided textLayouts, while some might not fit or not be intersecting the provided rect
  */
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer willRenderTextLayouts:(NSArray *)textLayouts inBoundingRect:(CGRect)rect withContext:(CGContextRef)context;
@@ -168,6 +209,7 @@
  @param rect The CGRect containing the textLayout object
  @param context CGContextRef where the textLayout object got rendered
  @warning This method will be called from the thread in which the renderTextLayoutsInContext:withRect: is called
+ @note When a PINCHTextView displays asynchronously, this is called on the main thread after rendering, with a NULL context
  */
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer didRenderTextLayout:(PINCHTextLayout *)textLayout inRect:(CGRect)rect withContext:(CGContextRef)context;
 
@@ -177,6 +219,7 @@
  @param rect Bounding CGRect of all rendered textLayouts combined
  @param context CGContextREd where the textLayout instances got rendered in
  @warning This method will be called from the thread in which the renderTextLayoutsInContext:withRect: is called
+ @note When a PINCHTextView displays asynchronously, this is called on the main thread after rendering, with a NULL context
  @note The array of textLayouts may contain less objects than all provided textLayouts, while some might not fit or not be intersecting the provided rect
  */
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer didRenderTextLayouts:(NSArray *)textLayouts withBoundingRect:(CGRect)rect inContext:(CGContextRef)context;
@@ -189,7 +232,8 @@
  @param URL The encountered URL
  @param range The full range of the url. Might be bigger than the line range
  @param rect The rect containing the url in the current line
- @note Always called asynchronously on the main thread, so UI logic can be done
+ @note Always called asynchronously on the main thread, so UI logic can be done.
+ Not called when the delegate implements textRenderer:didEncounterLinks:
  */
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer didEncounterURL:(NSURL *)URL inRange:(NSRange)range withRect:(CGRect)rect;
 
@@ -201,10 +245,20 @@
  @param result The encountered NSTextCheckingResult
  @param range The full range of the result. Might be bigger than the line range
  @param rect The rect containing the result in the current line
- @note Always called asynchronously on the main thread, so UI logic can be done
+ @note Always called asynchronously on the main thread, so UI logic can be done.
+ Not called when the delegate implements textRenderer:didEncounterLinks:
  */
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer didEncounterTextCheckingResult:(NSTextCheckingResult *)result inRange:(NSRange)range withRect:(CGRect)rect;
 
+/**
+ After rendering, informs the delegate of all links that have been found, at once instead of for every line of every link.
+ @param textRenderer the renderer
+ @param links NSArray of PINCHTextLink instances with the rects of all lines they are on, URLs and textCheckingResults
+ in the order they were encountered
+ @note Called once per render, on the main thread. When called from another thread, it's called asynchronously
+ */
+- (void)textRenderer:(PINCHTextRenderer *)textRenderer didEncounterLinks:(NSArray *)links;
+
 #if TARGET_OS_IOS
 /**
  When created on the main thread, a textLayout instance handles the dataDetectors on a different thread.
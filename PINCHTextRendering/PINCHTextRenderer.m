@@ -6,14 +6,109 @@
 //  Copyright (c) 2013 PINCH B.V. All rights reserved.
 //
 
+#import <stdatomic.h>
 #import "PINCHTextRenderer.h"
+#import "PINCHTextBitmapCache.h"
 #import "PINCHTextLayout.h"
+#import "PINCHTextLayoutResult.h"
+#import "PINCHTextLink.h"
+#import "PINCHTextMeasurementCache.h"
+#import "PINCHTextPrefetcher.h"
 
 static BOOL debugClipping = NO;
 static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 
+/// Space around the rect of a textLayout in its cached image, for glyphs that extend outside of their line
+static CGFloat bitmapPadding = 4;
+
+/// Calls measureBlock for every index on at most one thread per core, returns the NSValue-wrapped rects in index order
+static NSArray *PINCHTextRectsMeasuredConcurrently(NSUInteger count, CGRect(^measureBlock)(NSUInteger index))
+{
+	if (count == 0)
+	{
+		return @[];
+	}
+	
+	CGRect *rects = calloc(count, sizeof(CGRect));
+	NSUInteger numberOfWorkers = MIN(MAX([[NSProcessInfo processInfo] activeProcessorCount], 1), count);
+	
+	// Workers take the next index when done, so expensive items don't hold up a fixed share of the work
+	atomic_ulong nextIndex = 0;
+	atomic_ulong *nextIndexPointer = &nextIndex;
+	dispatch_apply(numberOfWorkers, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^(size_t worker) {
+		NSUInteger index;
+		while ((index = atomic_fetch_add(nextIndexPointer, 1)) < count)
+		{
+			@autoreleasepool
+			{
+				rects[index] = measureBlock(index);
+			}
+		}
+	});
+	
+	NSMutableArray *measuredRects = [NSMutableArray arrayWithCapacity:count];
+	for (NSUInteger index = 0; index < count; index++)
+	{
+		[measuredRects addObject:[NSValue valueWithCGRect:rects[index]]];
+	}
+	free(rects);
+	
+	return [measuredRects copy];
+}
+
+/// Returns a new transparent bitmap context of the given pixel size, release it with CGContextRelease() when done.
+/// Not reused, creating an image of a context that is drawn in again would make CoreGraphics copy the bitmap
+static CGContextRef PINCHBitmapContextCreate(size_t width, size_t height)
+{
+	CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+	CGContextRef context = CGBitmapContextCreate(NULL, width, height, 8, 0, colorSpace, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+	CGColorSpaceRelease(colorSpace);
+	return context;
+}
+
+/// Returns the rect at the origin with the width for the given index and unlimited height
+static CGRect PINCHTextMeasuringRect(NSArray *widths, NSUInteger index)
+{
+	NSNumber *width = ([widths count] == 1 ? widths[0] : widths[index]);
+	// The same height CGFLOAT_MAX is replaced with, so it can be used as containerRect as well
+	return CGRectMake(0, 0, [width doubleValue], 100000);
+}
+
+/// Keys of the threadDictionary for what a textRenderer collects while rendering on that thread
+static NSString *const PINCHTextRendererCollectedLinksKey = @"PINCHTextRendererCollectedLinks";
+static NSString *const PINCHTextRendererBitmapLinksKey = @"PINCHTextRendererBitmapLinks";
+
+/// What a textRenderer collects while rendering on a thread
+@interface PINCHTextRendererCollection : NSObject
+
+/// Only the textRenderer that stored the collection adds to it, another textRenderer rendering on the same thread doesn't
+@property (nonatomic, unsafe_unretained) PINCHTextRenderer *textRenderer;
+/// The encountered links as dictionaries with a Value, Range and Rect
+@property (nonatomic, strong) NSMutableArray *links;
+/// Calls to the delegate as blocks, made on the main thread after rendering. nil when the delegate is called while rendering
+@property (nonatomic, strong) NSMutableArray *delegateCalls;
+
+@end
+
+@implementation PINCHTextRendererCollection
+@end
+
 @interface PINCHTextRenderer ()
 
+- (UIImage *)imageOfTextLayouts:(NSArray *)textLayouts withSize:(CGSize)size scale:(CGFloat)scale cancelToken:(PINCHTextPrefetchToken *)cancelToken delegateCalls:(NSArray **)delegateCalls;
+- (NSMutableArray *)bitmapLinks;
+- (NSArray *)textLinksWithCollectedLinks:(NSArray *)collectedLinks;
+- (BOOL)addCollectedLinkWithValue:(id)value inRange:(NSRange)range withRect:(CGRect)rect;
+
+@end
+
+@interface PINCHTextRenderer (PINCHTextLayoutAdditions)
+
+- (void)textLayoutWillRender:(PINCHTextLayout *)textLayout inRect:(CGRect)rect withContext:(CGContextRef)context;
+- (void)textLayoutDidRender:(PINCHTextLayout *)textLayout inRect:(CGRect)rect withContext:(CGContextRef)context;
+- (void)notifyEncounteredURL:(NSURL *)URL inRange:(NSRange)range withRect:(CGRect)rect;
+- (void)notifyEncounteredTextCheckingResult:(NSTextCheckingResult *)result inRange:(NSRange)range withRect:(CGRect)rect;
+
 @end
 
 @interface PINCHTextLayout ()
@@ -22,6 +117,10 @@ static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 @property (nonatomic, copy, readwrite) NSArray *lineRects;
 /// Making stringFitsProposedRect accessibly by textRenderer
 @property (nonatomic, assign, readwrite) BOOL stringFitsProposedRect;
+/// Measuring that can be cancelled by the prefetcher
+- (PINCHTextLayoutResult *)layoutResultForProposedRect:(CGRect)proposedRect withClippingRect:(CGRect *)clippingRect containerRect:(CGRect)containerRect cancelToken:(PINCHTextPrefetchToken *)cancelToken;
+/// The key of the cached image of the textLayout
+- (uint64_t)bitmapKeyForRect:(CGRect)rect clippingRect:(CGRect)clippingRect scale:(CGFloat)scale;
 
 @end
 
@@ -203,7 +302,12 @@ static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 
 - (CGRect)boundingRectForLayoutsInProposedRect:(CGRect)rect
 {
-	NSArray *layoutRects = [self layoutRectsForLayoutsInProposedRect:rect withContext:NULL clippingRects:nil];
+	return [self boundingRectForLayoutsInProposedRect:rect cancelToken:nil];
+}
+
+- (CGRect)boundingRectForLayoutsInProposedRect:(CGRect)rect cancelToken:(PINCHTextPrefetchToken *)cancelToken
+{
+	NSArray *layoutRects = [self layoutRectsForLayoutsInProposedRect:rect withContext:NULL clippingRects:nil cancelToken:cancelToken];
 	__block CGRect boundingRect = CGRectZero;
 	
 	[layoutRects enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
@@ -225,7 +329,45 @@ static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 	return boundingRect;
 }
 
++ (NSArray *)boundingRectsForTextRenderers:(NSArray *)textRenderers withWidths:(NSArray *)widths
+{
+	NSParameterAssert([widths count] == 1 || [widths count] == [textRenderers count]);
+	
+	return PINCHTextRectsMeasuredConcurrently([textRenderers count], ^CGRect(NSUInteger index) {
+		PINCHTextRenderer *textRenderer = textRenderers[index];
+		return [textRenderer boundingRectForLayoutsInProposedRect:PINCHTextMeasuringRect(widths, index)];
+	});
+}
+
++ (NSArray *)boundingRectsForTextLayouts:(NSArray *)textLayouts withWidths:(NSArray *)widths
+{
+	NSParameterAssert([widths count] == 1 || [widths count] == [textLayouts count]);
+	
+	return PINCHTextRectsMeasuredConcurrently([textLayouts count], ^CGRect(NSUInteger index) {
+		PINCHTextLayout *textLayout = textLayouts[index];
+		CGRect rect = PINCHTextMeasuringRect(widths, index);
+		CGRect clippingRect = CGRectZero;
+		return [textLayout boundingRectForProposedRect:rect withClippingRect:&clippingRect containerRect:rect];
+	});
+}
+
 - (NSArray *)layoutRectsForLayoutsInProposedRect:(CGRect)rect withContext:(CGContextRef)context clippingRects:(NSArray **)clippingRects
+{
+	return [self layoutRectsForLayoutsInProposedRect:rect withContext:context clippingRects:clippingRects cancelToken:nil];
+}
+
+/// Returns nil when cancelToken gets cancelled before all textLayouts have been measured
+- (NSArray *)layoutRectsForLayoutsInProposedRect:(CGRect)rect withContext:(CGContextRef)context clippingRects:(NSArray **)clippingRects cancelToken:(PINCHTextPrefetchToken *)cancelToken
+{
+	@synchronized(self.textLayouts)
+	{
+		return [self layoutRectsForTextLayouts:self.textLayouts inProposedRect:rect withContext:context clippingRects:clippingRects cancelToken:cancelToken];
+	}
+}
+
+/// Measures textLayouts, the textLayouts of the textRenderer or a snapshot of them.
+/// Returns nil when cancelToken gets cancelled before all textLayouts have been measured
+- (NSArray *)layoutRectsForTextLayouts:(NSArray *)textLayouts inProposedRect:(CGRect)rect withContext:(CGContextRef)context clippingRects:(NSArray **)clippingRects cancelToken:(PINCHTextPrefetchToken *)cancelToken
 {
 	if (CGRectGetWidth(rect) == CGFLOAT_MAX)
 	{
@@ -245,137 +387,157 @@ static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 	
 	NSArray *layoutRects = nil;
 	
-	@synchronized(self.textLayouts)
+	NSMutableArray *textRects = [NSMutableArray arrayWithCapacity:[textLayouts count]];
+	NSMutableArray *textClippingRects = [NSMutableArray arrayWithCapacity:[textLayouts count]];
+	
+	BOOL shouldDrawLayouts = NO;
+	NSUInteger numberOfRelayouts = 0;
+	__block BOOL cancelled = NO;
+	
+	while (shouldDrawLayouts == NO)
 	{
-		NSMutableArray *textRects = [NSMutableArray arrayWithCapacity:[self.textLayouts count]];
-		NSMutableArray *textClippingRects = [NSMutableArray arrayWithCapacity:[self.textLayouts count]];
+		[textRects removeAllObjects];
+		[textClippingRects removeAllObjects];
 		
-		BOOL shouldDrawLayouts = NO;
-		NSUInteger numberOfRelayouts = 0;
+		__block CGRect remainingRect = rect;
+		__block CGRect layoutBounds = CGRectZero;
 		
-		while (shouldDrawLayouts == NO)
-		{
-			[textRects removeAllObjects];
-			[textClippingRects removeAllObjects];
+		// Calculate the rects, inform the delegates
+		[textLayouts enumerateObjectsUsingBlock:^(id obj, NSUInteger index, BOOL *stop) {
+			PINCHTextLayout *textLayout = obj;
 			
-			__block CGRect remainingRect = rect;
-			__block CGRect layoutBounds = CGRectZero;
+			CGRect clippingRect = [self clippingRectIntersectingRect:remainingRect];
+			PINCHTextLayoutResult *layoutResult = [textLayout layoutResultForProposedRect:remainingRect withClippingRect:&clippingRect containerRect:bounds cancelToken:cancelToken];
+			if (layoutResult == nil && cancelToken.isCancelled)
+			{
+				cancelled = YES;
+				*stop = YES;
+				return;
+			}
 			
-			// Calculate the rects, inform the delegates
-			[self.textLayouts enumerateObjectsUsingBlock:^(id obj, NSUInteger index, BOOL *stop) {
-				PINCHTextLayout *textLayout = obj;
-				
-				@synchronized(textLayout)
-				{
-					CGRect clippingRect = [self clippingRectIntersectingRect:remainingRect];
-					CGRect textRect = [textLayout boundingRectForProposedRect:remainingRect withClippingRect:&clippingRect containerRect:bounds];
-					
-					textRect.size.width = fminf(CGRectGetWidth(textRect), CGRectGetWidth(remainingRect));
-					
-					[textRects addObject:[NSValue valueWithCGRect:textRect]];
-					[textClippingRects addObject:[NSValue valueWithCGRect:clippingRect]];
-					
-					if ([self.delegate respondsToSelector:@selector(textRenderer:didCalculateBoundingRect:forTextLayout:)])
-					{
-						[self.delegate textRenderer:self didCalculateBoundingRect:textRect forTextLayout:textLayout];
-					}
-					
-					if (CGRectIsEmpty(textRect))
-					{
-						return;
-					}
-					
-					if (CGRectIsEmpty(layoutBounds))
-					{
-						layoutBounds = textRect;
-					}
-					else
+			CGRect textRect = layoutResult.boundingRect;
+			
+			textRect.size.width = fminf(CGRectGetWidth(textRect), CGRectGetWidth(remainingRect));
+			
+			[textRects addObject:[NSValue valueWithCGRect:textRect]];
+			[textClippingRects addObject:[NSValue valueWithCGRect:clippingRect]];
+			
+			if ([self.delegate respondsToSelector:@selector(textRenderer:didCalculateBoundingRect:forTextLayout:)])
+			{
+				[self callDelegateWithContext:context usingBlock:^(id <PINCHTextRendererDelegate> delegate, CGContextRef delegateContext) {
+					if ([delegate respondsToSelector:@selector(textRenderer:didCalculateBoundingRect:forTextLayout:)])
 					{
-						layoutBounds = CGRectUnion(layoutBounds, textRect);
+						[delegate textRenderer:self didCalculateBoundingRect:textRect forTextLayout:textLayout];
 					}
-					
-					remainingRect.size.height -= textRect.size.height;
-					remainingRect.origin.y = CGRectGetMaxY(textRect);
-				}
-			}];
+				}];
+			}
 			
-			if (self.alignsToBottom)
+			if (CGRectIsEmpty(textRect))
 			{
-				// Move all rects to the bottom
-				NSMutableArray *newRects = [NSMutableArray arrayWithCapacity:[textRects count]];
-				[textRects enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
-					NSValue *value = obj;
-					CGRect textLayoutRect = [value CGRectValue];
-					textLayoutRect.origin.y += CGRectGetMaxY(rect) - CGRectGetMaxY(layoutBounds);
-					NSValue *newValue = [NSValue valueWithCGRect:textLayoutRect];
-					[newRects addObject:newValue];
-				}];
-				textRects = newRects;
+				return;
 			}
 			
-			if (numberOfRelayouts < maximumNumberOfRelayoutAttempts && [self.delegate respondsToSelector:@selector(textRenderer:shouldRenderTextLayouts:)])
+			if (CGRectIsEmpty(layoutBounds))
 			{
-				shouldDrawLayouts = [self.delegate textRenderer:self shouldRenderTextLayouts:self.textLayouts];
+				layoutBounds = textRect;
 			}
 			else
 			{
-				shouldDrawLayouts = YES;
+				layoutBounds = CGRectUnion(layoutBounds, textRect);
 			}
 			
-			numberOfRelayouts++;
+			remainingRect.size.height -= textRect.size.height;
+			remainingRect.origin.y = CGRectGetMaxY(textRect);
+		}];
+		
+		if (cancelled)
+		{
+			return nil;
+		}
+		
+		if (self.alignsToBottom)
+		{
+			// Move all rects to the bottom
+			NSMutableArray *newRects = [NSMutableArray arrayWithCapacity:[textRects count]];
+			[textRects enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
+				NSValue *value = obj;
+				CGRect textLayoutRect = [value CGRectValue];
+				textLayoutRect.origin.y += CGRectGetMaxY(rect) - CGRectGetMaxY(layoutBounds);
+				NSValue *newValue = [NSValue valueWithCGRect:textLayoutRect];
+				[newRects addObject:newValue];
+			}];
+			textRects = newRects;
 		}
 		
-		layoutRects = [textRects copy];
-		if (clippingRects)
+		// The answer is needed right away, which the delegate can't give while it's called on the main thread later
+		BOOL defersDelegateCalls = ([self collectionForKey:PINCHTextRendererCollectedLinksKey].delegateCalls != nil);
+		if (numberOfRelayouts < maximumNumberOfRelayoutAttempts && !defersDelegateCalls && [self.delegate respondsToSelector:@selector(textRenderer:shouldRenderTextLayouts:)])
+		{
+			shouldDrawLayouts = [self.delegate textRenderer:self shouldRenderTextLayouts:textLayouts];
+		}
+		else
 		{
-			*clippingRects = [textClippingRects copy];
+			shouldDrawLayouts = YES;
 		}
+		
+		numberOfRelayouts++;
+	}
+	
+	layoutRects = [textRects copy];
+	if (clippingRects)
+	{
+		*clippingRects = [textClippingRects copy];
 	}
 	
 	return layoutRects;
 }
 
 - (void)renderTextLayoutsInContext:(CGContextRef)context withRect:(CGRect)rect
+{
+	if (![self delegateHandlesLinks] || [self collectionForKey:PINCHTextRendererCollectedLinksKey] != nil)
+	{
+		[self drawTextLayoutsInContext:context withRect:rect];
+		return;
+	}
+	
+	// Links are collected while drawing and delivered to the delegate at once
+	PINCHTextRendererCollection *collection = [self collectWithKey:PINCHTextRendererCollectedLinksKey delegateCalls:NO usingBlock:^{
+		[self drawTextLayoutsInContext:context withRect:rect];
+	}];
+	[self notifyEncounteredLinks:collection.links];
+}
+
+- (void)drawTextLayoutsInContext:(CGContextRef)context withRect:(CGRect)rect
 {
 	@synchronized(self.textLayouts)
 	{
-		NSArray *clippingRects = nil;
-		NSArray *layoutRects = [self layoutRectsForLayoutsInProposedRect:rect withContext:context clippingRects:&clippingRects];
+		[self drawTextLayouts:self.textLayouts inContext:context withRect:rect cancelToken:nil];
+	}
+}
+
+/// Draws textLayouts, the textLayouts of the textRenderer or a snapshot of them, and calls the delegate methods of every step
+/// except the encountered links. Returns NO when cancelToken gets cancelled before all textLayouts have been drawn
+- (BOOL)drawTextLayouts:(NSArray *)textLayouts inContext:(CGContextRef)context withRect:(CGRect)rect cancelToken:(PINCHTextPrefetchToken *)cancelToken
+{
+	NSArray *clippingRects = nil;
+	NSArray *layoutRects = [self layoutRectsForTextLayouts:textLayouts inProposedRect:rect withContext:context clippingRects:&clippingRects cancelToken:cancelToken];
+	if (layoutRects == nil)
+	{
+		return NO;
+	}
 	
-		__block CGRect boundingRect = CGRectZero;
-		NSMutableArray *drawnTextLayouts = [NSMutableArray array];
-		
-		if ([self.delegate respondsToSelector:@selector(textRenderer:willRenderTextLayouts:inBoundingRect:withContext:)])
-		{
-			// Delegate wants to now when all textLayouts will be rendered
-			[self.textLayouts enumerateObjectsUsingBlock:^(id obj, NSUInteger index, BOOL *stop) {
-				PINCHTextLayout *textLayout = obj;
-				CGRect textRect = [layoutRects[index] CGRectValue];
-				CGRect clippingRect = [clippingRects[index] CGRectValue];
-				
-				if ([self shouldRenderTextLayout:textLayout inContext:context withRect:textRect clippingRect:clippingRect])
-				{
-					if (CGRectIsEmpty(CGRectZero))
-					{
-						boundingRect = textRect;
-					}
-					else
-					{
-						boundingRect = CGRectUnion(boundingRect, textRect);
-					}
-					[drawnTextLayouts addObject:textLayout];
-				}
-			}];
-			
-			[self.delegate textRenderer:self willRenderTextLayouts:[drawnTextLayouts copy] inBoundingRect:boundingRect withContext:context];
-		}
-		
-		// Draw the strings
-		[self.textLayouts enumerateObjectsUsingBlock:^(id obj, NSUInteger index, BOOL *stop) {
+	__block CGRect boundingRect = CGRectZero;
+	NSMutableArray *drawnTextLayouts = [NSMutableArray array];
+	
+	if ([self.delegate respondsToSelector:@selector(textRenderer:willRenderTextLayouts:inBoundingRect:withContext:)])
+	{
+		// Delegate wants to now when all textLayouts will be rendered
+		[textLayouts enumerateObjectsUsingBlock:^(id obj, NSUInteger index, BOOL *stop) {
 			PINCHTextLayout *textLayout = obj;
 			CGRect textRect = [layoutRects[index] CGRectValue];
 			CGRect clippingRect = [clippingRects[index] CGRectValue];
-			if ([self renderTextLayout:textLayout inContext:context withRect:textRect clippingRect:clippingRect])
+			
+			if ([self shouldRenderTextLayout:textLayout inContext:context withRect:textRect clippingRect:clippingRect])
 			{
 				if (CGRectIsEmpty(CGRectZero))
 				{
@@ -385,19 +547,68 @@ static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 				{
 					boundingRect = CGRectUnion(boundingRect, textRect);
 				}
-				
-				if (![drawnTextLayouts containsObject:textLayout])
-				{
-					[drawnTextLayouts addObject:textLayout];
-				}
+				[drawnTextLayouts addObject:textLayout];
 			}
 		}];
 		
-		if ([self.delegate respondsToSelector:@selector(textRenderer:didRenderTextLayouts:withBoundingRect:inContext:)])
+		NSArray *willRenderTextLayouts = [drawnTextLayouts copy];
+		CGRect willRenderBoundingRect = boundingRect;
+		[self callDelegateWithContext:context usingBlock:^(id <PINCHTextRendererDelegate> delegate, CGContextRef delegateContext) {
+			if ([delegate respondsToSelector:@selector(textRenderer:willRenderTextLayouts:inBoundingRect:withContext:)])
+			{
+				[delegate textRenderer:self willRenderTextLayouts:willRenderTextLayouts inBoundingRect:willRenderBoundingRect withContext:delegateContext];
+			}
+		}];
+	}
+	
+	// Draw the strings
+	__block BOOL cancelled = NO;
+	[textLayouts enumerateObjectsUsingBlock:^(id obj, NSUInteger index, BOOL *stop) {
+		if (cancelToken.isCancelled)
 		{
-			[self.delegate textRenderer:self didRenderTextLayouts:[drawnTextLayouts copy] withBoundingRect:boundingRect inContext:context];
+			cancelled = YES;
+			*stop = YES;
+			return;
 		}
+		
+		PINCHTextLayout *textLayout = obj;
+		CGRect textRect = [layoutRects[index] CGRectValue];
+		CGRect clippingRect = [clippingRects[index] CGRectValue];
+		if ([self renderTextLayout:textLayout inContext:context withRect:textRect clippingRect:clippingRect])
+		{
+			if (CGRectIsEmpty(CGRectZero))
+			{
+				boundingRect = textRect;
+			}
+			else
+			{
+				boundingRect = CGRectUnion(boundingRect, textRect);
+			}
+			
+			if (![drawnTextLayouts containsObject:textLayout])
+			{
+				[drawnTextLayouts addObject:textLayout];
+			}
+		}
+	}];
+	
+	if (cancelled)
+	{
+		return NO;
 	}
+	
+	if ([self.delegate respondsToSelector:@selector(textRenderer:didRenderTextLayouts:withBoundingRect:inContext:)])
+	{
+		NSArray *didRenderTextLayouts = [drawnTextLayouts copy];
+		CGRect didRenderBoundingRect = boundingRect;
+		[self callDelegateWithContext:context usingBlock:^(id <PINCHTextRendererDelegate> delegate, CGContextRef delegateContext) {
+			if ([delegate respondsToSelector:@selector(textRenderer:didRenderTextLayouts:withBoundingRect:inContext:)])
+			{
+				[delegate textRenderer:self didRenderTextLayouts:didRenderTextLayouts withBoundingRect:didRenderBoundingRect inContext:delegateContext];
+			}
+		}];
+	}
+	return YES;
 }
 
 - (BOOL)shouldRenderTextLayout:(PINCHTextLayout *)textLayout inContext:(CGContextRef)context withRect:(CGRect)rect clippingRect:(CGRect)clippingRect
@@ -418,7 +629,369 @@ static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 		return NO;
 	}
 	
-	[textLayout drawInContext:context withRect:rect clippingRect:clippingRect];
+	PINCHTextBitmapCache *bitmapCache = self.bitmapCache;
+	if (bitmapCache)
+	{
+		[self renderTextLayout:textLayout withBitmapCache:bitmapCache inContext:context withRect:rect clippingRect:clippingRect];
+	}
+	else
+	{
+		[textLayout drawInContext:context withRect:rect clippingRect:clippingRect];
+	}
+	return YES;
+}
+
+#pragma mark - Bitmap cache
+
+/// Draws the cached image of the textLayout, rendering and caching it first when there is none
+- (void)renderTextLayout:(PINCHTextLayout *)textLayout withBitmapCache:(PINCHTextBitmapCache *)bitmapCache inContext:(CGContextRef)context withRect:(CGRect)rect clippingRect:(CGRect)clippingRect
+{
+	CGFloat scale = PINCHContextGetScale(context);
+	
+	// On whole pixels, so the image is drawn without being resampled and looks exactly like the textLayout drawn directly
+	CGRect paddedRect = CGRectInset(rect, -bitmapPadding, -bitmapPadding);
+	CGFloat minX = floor(CGRectGetMinX(paddedRect) * scale) / scale;
+	CGFloat minY = floor(CGRectGetMinY(paddedRect) * scale) / scale;
+	CGRect imageRect = CGRectMake(minX, minY, ceil(CGRectGetMaxX(paddedRect) * scale) / scale - minX, ceil(CGRectGetMaxY(paddedRect) * scale) / scale - minY);
+	
+	// A textLayout at another fraction of a pixel is drawn at another position within the image
+	uint64_t key = [textLayout bitmapKeyForRect:rect clippingRect:clippingRect scale:scale];
+	CGPoint imageOffset = CGPointMake(CGRectGetMinX(rect) - minX, CGRectGetMinY(rect) - minY);
+	key = PINCHTextMeasurementHash(key, &imageOffset, sizeof(imageOffset));
+	
+	NSArray *links = nil;
+	CGImageRef image = [bitmapCache copyImageForKey:key links:&links];
+	if (image == NULL)
+	{
+		image = [self newImageWithTextLayout:textLayout inRect:rect clippingRect:clippingRect imageRect:imageRect scale:scale links:&links];
+		if (image == NULL)
+		{
+			[textLayout drawInContext:context withRect:rect clippingRect:clippingRect];
+			return;
+		}
+		[bitmapCache setImage:image links:links forKey:key];
+	}
+	
+	[self textLayoutWillRender:textLayout inRect:rect withContext:context];
+	
+	CGContextSaveGState(context);
+	{
+		// Images are drawn upside down in flipped contexts
+		CGContextTranslateCTM(context, 0, CGRectGetMinY(imageRect) + CGRectGetMaxY(imageRect));
+		CGContextScaleCTM(context, 1, -1);
+		CGContextDrawImage(context, imageRect, image);
+	}
+	CGContextRestoreGState(context);
+	CGImageRelease(image);
+	
+	// The links are stored relative to the image
+	for (NSDictionary *link in links)
+	{
+		CGRect linkRect = CGRectOffset([link[@"Rect"] CGRectValue], CGRectGetMinX(imageRect), CGRectGetMinY(imageRect));
+		NSRange range = [link[@"Range"] rangeValue];
+		id value = link[@"Value"];
+		if ([value isKindOfClass:[NSTextCheckingResult class]])
+		{
+			[self notifyEncounteredTextCheckingResult:value inRange:range withRect:linkRect];
+		}
+		else
+		{
+			[self notifyEncounteredURL:value inRange:range withRect:linkRect];
+		}
+	}
+	
+	[self textLayoutDidRender:textLayout inRect:rect withContext:context];
+}
+
+/// Renders the textLayout into a transparent image of imageRect at the given scale, collecting the links relative to the image
+- (CGImageRef)newImageWithTextLayout:(PINCHTextLayout *)textLayout inRect:(CGRect)rect clippingRect:(CGRect)clippingRect imageRect:(CGRect)imageRect scale:(CGFloat)scale links:(NSArray **)links
+{
+	// imageRect is on whole pixels, rounding only removes floating point errors
+	size_t width = (size_t)round(CGRectGetWidth(imageRect) * scale);
+	size_t height = (size_t)round(CGRectGetHeight(imageRect) * scale);
+	CGContextRef imageContext = PINCHBitmapContextCreate(width, height);
+	if (imageContext == NULL)
+	{
+		return NULL;
+	}
+	
+	// Flipped like UIKit contexts, the textLayout is drawn relative to the image so its clip bounding box starts at the origin
+	CGContextTranslateCTM(imageContext, 0, height);
+	CGContextScaleCTM(imageContext, scale, -scale);
+	CGRect imageTextRect = CGRectOffset(rect, -CGRectGetMinX(imageRect), -CGRectGetMinY(imageRect));
+	CGRect imageClippingRect = (CGRectIsEmpty(clippingRect) ? clippingRect : CGRectOffset(clippingRect, -CGRectGetMinX(imageRect), -CGRectGetMinY(imageRect)));
+	
+	// Links are collected per thread, so the textLayout can be drawn without locking the textRenderer
+	PINCHTextRendererCollection *collection = [self collectWithKey:PINCHTextRendererBitmapLinksKey delegateCalls:NO usingBlock:^{
+		[textLayout drawInContext:imageContext withRect:imageTextRect clippingRect:imageClippingRect];
+	}];
+	CGImageRef image = CGBitmapContextCreateImage(imageContext);
+	CGContextRelease(imageContext);
+	
+	if (links != NULL)
+	{
+		*links = [collection.links copy];
+	}
+	
+	return image;
+}
+
+#pragma mark - Offscreen rendering
+
+- (UIImage *)imageOfTextLayoutsWithSize:(CGSize)size scale:(CGFloat)scale
+{
+	return [self imageWithSize:size scale:scale drawingBlock:^BOOL(CGContextRef context, CGRect rect) {
+		[self renderTextLayoutsInContext:context withRect:rect];
+		return YES;
+	}];
+}
+
+/// Renders textLayouts, a snapshot of the textLayouts of the textRenderer, returning the calls to the delegate instead of making them.
+/// The calls are made on the main thread by calling the blocks. Returns nil when cancelToken gets cancelled before the image is done
+- (UIImage *)imageOfTextLayouts:(NSArray *)textLayouts withSize:(CGSize)size scale:(CGFloat)scale cancelToken:(PINCHTextPrefetchToken *)cancelToken delegateCalls:(NSArray **)delegateCalls
+{
+	__block NSArray *collectedDelegateCalls = nil;
+	UIImage *image = [self imageWithSize:size scale:scale drawingBlock:^BOOL(CGContextRef context, CGRect rect) {
+		__block BOOL drawn = NO;
+		PINCHTextRendererCollection *collection = [self collectWithKey:PINCHTextRendererCollectedLinksKey delegateCalls:YES usingBlock:^{
+			drawn = [self drawTextLayouts:textLayouts inContext:context withRect:rect cancelToken:cancelToken];
+		}];
+		
+		// The links are delivered last, like they are after drawing on the main thread
+		void(^linksCall)(void) = [self delegateCallWithCollectedLinks:collection.links];
+		if (linksCall)
+		{
+			[collection.delegateCalls addObject:linksCall];
+		}
+		collectedDelegateCalls = [collection.delegateCalls copy];
+		return drawn;
+	}];
+	
+	if (delegateCalls != NULL)
+	{
+		*delegateCalls = (image ? collectedDelegateCalls : nil);
+	}
+	return image;
+}
+
+/// Draws in a transparent image of size at scale, flipped like UIKit contexts so the result is the same as drawing
+/// in a UIGraphics image context. Returns nil when drawingBlock returns NO
+- (UIImage *)imageWithSize:(CGSize)size scale:(CGFloat)scale drawingBlock:(BOOL(^)(CGContextRef context, CGRect rect))drawingBlock
+{
+	NSParameterAssert(scale > 0);
+	
+	size_t width = (size_t)ceil(size.width * scale);
+	size_t height = (size_t)ceil(size.height * scale);
+	if (width == 0 || height == 0)
+	{
+		return nil;
+	}
+	
+	CGContextRef context = PINCHBitmapContextCreate(width, height);
+	if (context == NULL)
+	{
+		return nil;
+	}
+	
+	CGContextTranslateCTM(context, 0, height);
+	CGContextScaleCTM(context, scale, -scale);
+	BOOL drawn = drawingBlock(context, (CGRect){CGPointZero, size});
+	
+	CGImageRef imageRef = (drawn ? CGBitmapContextCreateImage(context) : NULL);
+	CGContextRelease(context);
+	if (imageRef == NULL)
+	{
+		return nil;
+	}
+	
+	UIImage *image = [UIImage imageWithCGImage:imageRef scale:scale orientation:UIImageOrientationUp];
+	CGImageRelease(imageRef);
+	return image;
+}
+
+#pragma mark - Collecting links
+
+/// The collection stored under key when this textRenderer is rendering on this thread, nil otherwise
+- (PINCHTextRendererCollection *)collectionForKey:(NSString *)key
+{
+	PINCHTextRendererCollection *collection = [[NSThread currentThread] threadDictionary][key];
+	return (collection.textRenderer == self ? collection : nil);
+}
+
+/// Stores a new collection under key while block runs, then restores the collection of a textRenderer that was already rendering
+- (PINCHTextRendererCollection *)collectWithKey:(NSString *)key delegateCalls:(BOOL)collectsDelegateCalls usingBlock:(void(^)(void))block
+{
+	NSMutableDictionary *threadDictionary = [[NSThread currentThread] threadDictionary];
+	PINCHTextRendererCollection *previousCollection = threadDictionary[key];
+	
+	PINCHTextRendererCollection *collection = [[PINCHTextRendererCollection alloc] init];
+	collection.textRenderer = self;
+	collection.links = [NSMutableArray array];
+	collection.delegateCalls = (collectsDelegateCalls ? [NSMutableArray array] : nil);
+	threadDictionary[key] = collection;
+	
+	block();
+	
+	if (previousCollection)
+	{
+		threadDictionary[key] = previousCollection;
+	}
+	else
+	{
+		[threadDictionary removeObjectForKey:key];
+	}
+	return collection;
+}
+
+/// Calls the delegate with context, or collects the call when this thread renders for the main thread.
+/// Collected calls are made after rendering, when the context is gone, so they get a NULL context
+- (void)callDelegateWithContext:(CGContextRef)context usingBlock:(void(^)(id <PINCHTextRendererDelegate> delegate, CGContextRef context))block
+{
+	NSMutableArray *delegateCalls = [self collectionForKey:PINCHTextRendererCollectedLinksKey].delegateCalls;
+	if (delegateCalls == nil)
+	{
+		block(self.delegate, context);
+		return;
+	}
+	
+	[delegateCalls addObject:^{
+		block(self.delegate, NULL);
+	}];
+}
+
+/// Creates textLinks from collected links, with the rects of consecutive links with the same range combined in one textLink
+- (NSArray *)textLinksWithCollectedLinks:(NSArray *)collectedLinks
+{
+	NSMutableArray *textLinks = [NSMutableArray arrayWithCapacity:[collectedLinks count]];
+	PINCHTextLink *previousURLLink = nil;
+	PINCHTextLink *previousResultLink = nil;
+	
+	for (NSDictionary *collectedLink in collectedLinks)
+	{
+		id value = collectedLink[@"Value"];
+		NSRange range = [collectedLink[@"Range"] rangeValue];
+		CGRect rect = [collectedLink[@"Rect"] CGRectValue];
+		BOOL isTextCheckingResult = [value isKindOfClass:[NSTextCheckingResult class]];
+		
+		PINCHTextLink *previousLink = (isTextCheckingResult ? previousResultLink : previousURLLink);
+		if (previousLink && NSEqualRanges(previousLink.range, range))
+		{
+			[previousLink addRect:rect];
+			continue;
+		}
+		
+		PINCHTextLink *textLink = nil;
+		if (isTextCheckingResult)
+		{
+			textLink = [[PINCHTextLink alloc] initWithTextCheckingResult:value rect:rect];
+			previousResultLink = textLink;
+		}
+		else
+		{
+			textLink = [[PINCHTextLink alloc] initWithURL:value range:range rect:rect];
+			previousURLLink = textLink;
+		}
+		[textLinks addObject:textLink];
+	}
+	return [textLinks copy];
+}
+
+/// Whether the delegate wants to know about the links in the textLayouts
+- (BOOL)delegateHandlesLinks
+{
+	return ([self.delegate respondsToSelector:@selector(textRenderer:didEncounterLinks:)] ||
+			[self.delegate respondsToSelector:@selector(textRenderer:didEncounterURL:inRange:withRect:)] ||
+			[self.delegate respondsToSelector:@selector(textRenderer:didEncounterTextCheckingResult:inRange:withRect:)]);
+}
+
+/// Delivers all links collected in a render to the delegate in a single pass on the main thread
+- (void)notifyEncounteredLinks:(NSArray *)collectedLinks
+{
+	void(^notifyBlock)(void) = [self delegateCallWithCollectedLinks:collectedLinks];
+	if (notifyBlock == nil)
+	{
+		return;
+	}
+	
+	if ([[NSThread currentThread] isMainThread])
+	{
+		notifyBlock();
+	}
+	else
+	{
+		dispatch_async(dispatch_get_main_queue(), notifyBlock);
+	}
+}
+
+/// The call delivering all links collected in a render to the delegate in a single pass, nil when there are none
+- (void(^)(void))delegateCallWithCollectedLinks:(NSArray *)collectedLinks
+{
+	if ([collectedLinks count] == 0)
+	{
+		return nil;
+	}
+	
+	// Created on the rendering thread, so the main thread only has to hand them over
+	NSArray *textLinks = nil;
+	if ([self.delegate respondsToSelector:@selector(textRenderer:didEncounterLinks:)])
+	{
+		textLinks = [self textLinksWithCollectedLinks:collectedLinks];
+	}
+	
+	void(^notifyBlock)(void) = ^ {
+		if (textLinks)
+		{
+			if ([self.delegate respondsToSelector:@selector(textRenderer:didEncounterLinks:)])
+			{
+				[self.delegate textRenderer:self didEncounterLinks:textLinks];
+			}
+			return;
+		}
+		
+		// Every rect, in the order they were encountered while drawing
+		for (NSDictionary *collectedLink in collectedLinks)
+		{
+			id value = collectedLink[@"Value"];
+			NSRange range = [collectedLink[@"Range"] rangeValue];
+			CGRect rect = [collectedLink[@"Rect"] CGRectValue];
+			if ([value isKindOfClass:[NSTextCheckingResult class]])
+			{
+				if ([self.delegate respondsToSelector:@selector(textRenderer:didEncounterTextCheckingResult:inRange:withRect:)])
+				{
+					[self.delegate textRenderer:self didEncounterTextCheckingResult:value inRange:range withRect:rect];
+				}
+			}
+			else if ([self.delegate respondsToSelector:@selector(textRenderer:didEncounterURL:inRange:withRect:)])
+			{
+				[self.delegate textRenderer:self didEncounterURL:value inRange:range withRect:rect];
+			}
+		}
+	};
+	return notifyBlock;
+}
+
+/// The links collected while a textLayout is rendered into an image on this thread, nil otherwise
+- (NSMutableArray *)bitmapLinks
+{
+	return [self collectionForKey:PINCHTextRendererBitmapLinksKey].links;
+}
+
+/// Stores a link encountered while rendering an image or collecting links, returns NO when neither happens on this thread
+- (BOOL)addCollectedLinkWithValue:(id)value inRange:(NSRange)range withRect:(CGRect)rect
+{
+	// Links of an image are added to the collected links when the image is drawn
+	NSMutableArray *links = [self bitmapLinks] ?: [self collectionForKey:PINCHTextRendererCollectedLinksKey].links;
+	if (links == nil)
+	{
+		return NO;
+	}
+	
+	if (value)
+	{
+		[links addObject:@{@"Value": value,
+						   @"Range": [NSValue valueWithRange:range],
+						   @"Rect": [NSValue valueWithCGRect:rect]}];
+	}
 	return YES;
 }
 
@@ -443,27 +1016,53 @@ static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 
 - (void)textLayoutWillRender:(PINCHTextLayout *)textLayout inRect:(CGRect)rect withContext:(CGContextRef)context
 {
+	if ([self bitmapLinks] != nil)
+	{
+		// Called with the context the image is drawn in instead
+		return;
+	}
+	
 	if ([self.delegate respondsToSelector:@selector(textRenderer:willRenderTextLayout:inRect:withContext:)])
 	{
-		[self.delegate textRenderer:self willRenderTextLayout:textLayout inRect:rect withContext:context];
+		[self callDelegateWithContext:context usingBlock:^(id <PINCHTextRendererDelegate> delegate, CGContextRef delegateContext) {
+			if ([delegate respondsToSelector:@selector(textRenderer:willRenderTextLayout:inRect:withContext:)])
+			{
+				[delegate textRenderer:self willRenderTextLayout:textLayout inRect:rect withContext:delegateContext];
+			}
+		}];
 	}
 }
 
 - (void)textLayoutDidRender:(PINCHTextLayout *)textLayout inRect:(CGRect)rect withContext:(CGContextRef)context
 {
+	if ([self bitmapLinks] != nil)
+	{
+		return;
+	}
+	
 	if ([self.delegate respondsToSelector:@selector(textRenderer:didRenderTextLayout:inRect:withContext:)])
 	{
-		[self.delegate textRenderer:self didRenderTextLayout:textLayout inRect:rect withContext:context];
+		[self callDelegateWithContext:context usingBlock:^(id <PINCHTextRendererDelegate> delegate, CGContextRef delegateContext) {
+			if ([delegate respondsToSelector:@selector(textRenderer:didRenderTextLayout:inRect:withContext:)])
+			{
+				[delegate textRenderer:self didRenderTextLayout:textLayout inRect:rect withContext:delegateContext];
+			}
+		}];
 	}
 }
 
 - (BOOL)textLayoutShouldCheckForURLS:(PINCHTextLayout *)textLayout
 {
-	return ([self.delegate respondsToSelector:@selector(textRenderer:didEncounterURL:inRange:withRect:)] || [self.delegate respondsToSelector:@selector(textRenderer:didEncounterTextCheckingResult:inRange:withRect:)]);
+	return [self delegateHandlesLinks];
 }
 
 - (void)notifyEncounteredURL:(NSURL *)URL inRange:(NSRange)range withRect:(CGRect)rect
 {
+	if ([self addCollectedLinkWithValue:URL inRange:range withRect:rect])
+	{
+		return;
+	}
+	
 	void(^notifyBlock)(void) = ^ {
 		if ([self.delegate respondsToSelector:@selector(textRenderer:didEncounterURL:inRange:withRect:)])
 		{
@@ -483,6 +1082,11 @@ static NSUInteger maximumNumberOfRelayoutAttempts = 5;
 
 - (void)notifyEncounteredTextCheckingResult:(NSTextCheckingResult *)result inRange:(NSRange)range withRect:(CGRect)rect
 {
+	if ([self addCollectedLinkWithValue:result inRange:range withRect:rect])
+	{
+		return;
+	}
+	
 	void(^notifyBlock)(void) = ^ {
 		if ([self.delegate respondsToSelector:@selector(textRenderer:didEncounterTextCheckingResult:inRange:withRect:)])
 		{
@@ -11,7 +11,14 @@
 
 #define PINCHTextWeakObject(__object, __weakObject) __weak __typeof(__object) __weakObject = __object;
 
+#import "PINCHTextBitmapCache.h"
+#import "PINCHTextDataDetector.h"
+#import "PINCHTextHyphenator.h"
 #import "PINCHTextLayout.h"
+#import "PINCHTextLayoutResult.h"
+#import "PINCHTextLinkIndex.h"
+#import "PINCHTextMeasurementCache.h"
+#import "PINCHTextPrefetcher.h"
 #import "PINCHTextRenderer.h"
 #import "PINCHTextView.h"
 
@@ -42,6 +42,21 @@
  */
 - (PINCHTextLink *)textLinkLinkAtPoint:(CGPoint)point;
 
+/**
+ Whether the textLayouts are rendered on a background queue instead of in drawRect: on the main thread.
+ The rendered image is shown when it's done, renders are cancelled when the textLayouts or the size change.
+ The textLayouts can be measured on the main thread, for instance to size a cell, while they're being rendered.
+ The calls to the delegate of the renderer are made on the main thread when the image is shown. Default is NO
+ */
+@property (nonatomic, assign) BOOL displaysAsynchronously;
+
+/**
+ Whether textLayouts are drawn from the images in the sharedCache of PINCHTextBitmapCache when an identical
+ textLayout has been drawn in the same size before, for instance in reused cells. Images are only shared
+ while they're in the cache, which costs memory. Default is NO
+ */
+@property (nonatomic, assign) BOOL usesBitmapCache;
+
 /**
  Wether the drawn layouts should show borders and background colors,
  used for debugging.
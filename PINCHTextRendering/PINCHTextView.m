@@ -52,11 +52,49 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 
 @end
 
+@interface PINCHTextView ()
+
+- (void)displayLayerAsynchronously:(CALayer *)layer;
+
+@end
+
+/// Layer that lets the textView display its contents on a background queue instead of drawing them in drawRect:
+@interface PINCHTextViewLayer : CALayer
+
+@property (atomic, assign) BOOL displaysAsynchronously;
+
+@end
+
+@implementation PINCHTextViewLayer
+
+- (void)display
+{
+	id delegate = self.delegate;
+	if (self.displaysAsynchronously && [delegate isKindOfClass:[PINCHTextView class]])
+	{
+		[(PINCHTextView *)delegate displayLayerAsynchronously:self];
+	}
+	else
+	{
+		[super display];
+	}
+}
+
+@end
+
+@interface PINCHTextRenderer ()
+
+- (UIImage *)imageOfTextLayouts:(NSArray *)textLayouts withSize:(CGSize)size scale:(CGFloat)scale cancelToken:(PINCHTextPrefetchToken *)cancelToken delegateCalls:(NSArray **)delegateCalls;
+
+@end
+
 @interface PINCHTextView () <PINCHTextRendererDelegate>
 
 @property (nonatomic, strong, readwrite) PINCHTextRenderer *renderer;
 @property (nonatomic, strong) NSMutableArray *URLLinks;
 @property (nonatomic, strong) NSMutableArray *resultLinks;
+/// Index of the rects of URLLinks and resultLinks, created when a link is first looked up after the links changed
+@property (nonatomic, strong) PINCHTextLinkIndex *linkIndex;
 @property (nonatomic, strong) PINCHTextLink *highlightedLink;
 @property (nonatomic, strong) PINCHTextLink *highlightingLink;
 @property (nonatomic, strong) PINCHBlockDrawingView *linkHighlightView;
@@ -64,6 +102,15 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 @end
 
 @implementation PINCHTextView
+{
+	// Replaced for every asynchronous display, cancelling the render of the previous display. Only used on the main thread
+	PINCHTextPrefetchToken *_displayToken;
+}
+
++ (Class)layerClass
+{
+	return [PINCHTextViewLayer class];
+}
 
 #pragma mark - Initializers
 
@@ -140,6 +187,7 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer didUpdateTextLayouts:(NSArray *)textLayouts
 {
+	[self cancelAsynchronousDisplay];
 	if ([self.delegate respondsToSelector:@selector(textViewDidUpdateLayoutAttributes:)])
 	{
 		[self.delegate textViewDidUpdateLayoutAttributes:self];
@@ -151,7 +199,8 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer willRenderTextLayout:(PINCHTextLayout *)textLayout inRect:(CGRect)rect withContext:(CGContextRef)context
 {
-	if (self.debugRendering)
+	// Asynchronous renders call after the image is done, without a context
+	if (self.debugRendering && context != NULL)
 	{
 		CGContextSaveGState(context);
 		{
@@ -180,10 +229,17 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 
 - (BOOL)textRenderer:(PINCHTextRenderer *)textRenderer shouldRenderTextLayouts:(NSArray *)textLayouts
 {
+	if (self.displaysAsynchronously && ![[NSThread currentThread] isMainThread])
+	{
+		// The links are replaced together with the image
+		return YES;
+	}
+	
 	PINCHTextWeakObject(self, weakSelf);
 	void(^beginBlock)(void) = ^ {
 		[weakSelf.URLLinks removeAllObjects];
 		[weakSelf.resultLinks removeAllObjects];
+		weakSelf.linkIndex = nil;
 		weakSelf.highlightedLink = nil;
 		weakSelf.highlightingLink = nil;
 	};
@@ -201,7 +257,7 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer didRenderTextLayout:(PINCHTextLayout *)textLayout inRect:(CGRect)rect withContext:(CGContextRef)context
 {
-	if (self.debugRendering)
+	if (self.debugRendering && context != NULL)
 	{
 		CGFloat scale = [[UIScreen mainScreen] scale];
 		CGFloat lineWidth = 1.f / scale;
@@ -230,6 +286,7 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 		PINCHTextLink *textLink = [[PINCHTextLink alloc] initWithURL:URL range:range rect:rect];
 		[self.URLLinks addObject:textLink];
 	}
+	self.linkIndex = nil;
 }
 
 - (void)textRenderer:(PINCHTextRenderer *)textRenderer didEncounterTextCheckingResult:(NSTextCheckingResult *)result inRange:(NSRange)range withRect:(CGRect)rect
@@ -244,6 +301,23 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 		PINCHTextLink *textLink = [[PINCHTextLink alloc] initWithTextCheckingResult:result rect:rect];
 		[self.resultLinks addObject:textLink];
 	}
+	self.linkIndex = nil;
+}
+
+- (void)textRenderer:(PINCHTextRenderer *)textRenderer didEncounterLinks:(NSArray *)links
+{
+	for (PINCHTextLink *link in links)
+	{
+		if (link.textLinkType == PINCHTextLinkTypeTextCheckingResult)
+		{
+			[self.resultLinks addObject:link];
+		}
+		else
+		{
+			[self.URLLinks addObject:link];
+		}
+	}
+	self.linkIndex = nil;
 }
 
 #if TARGET_OS_IOS
@@ -255,46 +329,19 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 
 #pragma mark - Tapping links
 
-- (PINCHTextLink *)textLinkLinkAtPoint:(CGPoint)point
+- (PINCHTextLinkIndex *)linkIndex
 {
-	__block PINCHTextLink *foundLink = nil;
-	
-	void(^specificEnumerator)(id obj, NSUInteger idx, BOOL *stop) = ^(id obj, NSUInteger index, BOOL *stop) {
-		PINCHTextLink *link = obj;
-		if ([link containsPoint:point])
-		{
-			foundLink = link;
-			*stop = YES;
-		}
-	};
-	
-	void(^regionEnumerator)(id obj, NSUInteger idx, BOOL *stop) = ^(id obj, NSUInteger index, BOOL *stop) {
-		PINCHTextLink *link = obj;
-		if ([link touchRegionContainsPoint:point])
-		{
-			foundLink = link;
-			*stop = YES;
-		}
-	};
-	
-	[self.URLLinks enumerateObjectsUsingBlock:specificEnumerator];
-	
-	if (!foundLink)
+	if (!_linkIndex)
 	{
-		[self.resultLinks enumerateObjectsUsingBlock:specificEnumerator];
+		// Exact links are preferred over touch regions, and URLs over textCheckingResults
+		_linkIndex = [[PINCHTextLinkIndex alloc] initWithLinkGroups:@[self.URLLinks, self.resultLinks]];
 	}
-	
-	if (!foundLink)
-	{
-		[self.URLLinks enumerateObjectsUsingBlock:regionEnumerator];
-	}
-	
-	if (!foundLink)
-	{
-		[self.resultLinks enumerateObjectsUsingBlock:regionEnumerator];
-	}
-	
-	return foundLink;
+	return _linkIndex;
+}
+
+- (PINCHTextLink *)textLinkLinkAtPoint:(CGPoint)point
+{
+	return [self.linkIndex linkAtPoint:point];
 }
 
 - (void)touchesBegan:(NSSet *)touches withEvent:(UIEvent *)event
@@ -383,6 +430,126 @@ typedef void(^PINCHDrawingBlock)(CGRect bounds, CGContextRef context);
 	[self.renderer renderTextLayoutsInContext:context withRect:self.bounds];
 }
 
+#pragma mark - Bitmap cache
+
+- (void)setUsesBitmapCache:(BOOL)usesBitmapCache
+{
+	if (usesBitmapCache == self.usesBitmapCache)
+		return;
+	self.renderer.bitmapCache = (usesBitmapCache ? [PINCHTextBitmapCache sharedCache] : nil);
+	[self setNeedsDisplay];
+}
+
+- (BOOL)usesBitmapCache
+{
+	return (self.renderer.bitmapCache != nil);
+}
+
+#pragma mark - Asynchronous display
+
+- (void)setDisplaysAsynchronously:(BOOL)displaysAsynchronously
+{
+	if (displaysAsynchronously == _displaysAsynchronously)
+		return;
+	_displaysAsynchronously = displaysAsynchronously;
+	
+	[self cancelAsynchronousDisplay];
+	((PINCHTextViewLayer *)self.layer).displaysAsynchronously = displaysAsynchronously;
+	self.layer.contents = nil;
+	[self.layer setNeedsDisplay];
+}
+
+- (void)setBounds:(CGRect)bounds
+{
+	if (!CGSizeEqualToSize(bounds.size, self.bounds.size))
+	{
+		[self cancelAsynchronousDisplay];
+	}
+	[super setBounds:bounds];
+}
+
+- (void)setFrame:(CGRect)frame
+{
+	if (!CGSizeEqualToSize(frame.size, self.frame.size))
+	{
+		[self cancelAsynchronousDisplay];
+	}
+	[super setFrame:frame];
+}
+
+/// Makes sure renders that are in progress stop and won't be shown
+- (void)cancelAsynchronousDisplay
+{
+	[_displayToken cancel];
+	_displayToken = nil;
+}
+
+- (void)displayLayerAsynchronously:(CALayer *)layer
+{
+	[self cancelAsynchronousDisplay];
+	
+	CGRect bounds = self.bounds;
+	CGFloat scale = layer.contentsScale;
+	PINCHTextRenderer *renderer = self.renderer;
+	
+	if (CGRectIsEmpty(bounds))
+	{
+		layer.contents = nil;
+		return;
+	}
+	
+	// The textLayouts can change on the main thread while rendering, the render shows them as they were when the display started
+	NSArray *textLayouts = nil;
+	@synchronized(renderer.textLayouts)
+	{
+		textLayouts = [renderer.textLayouts copy];
+	}
+	
+	PINCHTextPrefetchToken *displayToken = [[PINCHTextPrefetchToken alloc] init];
+	_displayToken = displayToken;
+	
+	PINCHTextWeakObject(self, weakSelf);
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+		if (displayToken.isCancelled)
+		{
+			return;
+		}
+		
+		NSArray *delegateCalls = nil;
+		UIImage *image = [renderer imageOfTextLayouts:textLayouts withSize:bounds.size scale:scale cancelToken:displayToken delegateCalls:&delegateCalls];
+		if (image == nil)
+		{
+			return;
+		}
+		
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (displayToken.isCancelled)
+			{
+				return;
+			}
+			
+			// The links are replaced in the same pass as the contents, so they always match what's shown
+			layer.contents = (__bridge id)image.CGImage;
+			[weakSelf replaceLinksWithDelegateCalls:delegateCalls];
+		});
+	});
+}
+
+/// Removes the links of the previous render, then makes the calls to the delegate of the textRenderer collected while rendering
+- (void)replaceLinksWithDelegateCalls:(NSArray *)delegateCalls
+{
+	[self.URLLinks removeAllObjects];
+	[self.resultLinks removeAllObjects];
+	self.linkIndex = nil;
+	self.highlightedLink = nil;
+	self.highlightingLink = nil;
+	
+	for (void(^delegateCall)(void) in delegateCalls)
+	{
+		delegateCall();
+	}
+}
+
 #pragma mark - Auto Layout Support
 
 - (CGSize)intrinsicContentSize